@@ -0,0 +1,199 @@
+
+#include "file_transfer.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <io.h>
+
+#include "lz.h"
+
+namespace fs = std::filesystem;
+
+FileTransfer::Codec FileTransfer::choose(uint32_t mask)
+{
+    return (mask & codecs & (1 << Lz)) ? Lz : Raw;
+}
+
+FileTransfer::Codec FileTransfer::pack(Codec codec, const std::string& data, std::string& out)
+{
+    out.clear();
+
+    if (codec == Lz && Lz::isCompressible(data.data(), data.size()) && Lz::compress(data.data(), data.size(), out))
+    {
+        return Lz;
+    }
+
+    out.clear();
+    return Raw;
+}
+
+bool FileTransfer::unpack(uint32_t codec, const std::string& data, size_t rawSize, std::string& out)
+{
+    switch (codec)
+    {
+        case Lz: return Lz::decompress(data.data(), data.size(), rawSize, out);
+        default: return false;
+    }
+}
+
+ChunkReader::ChunkReader(const std::string& filename) :
+    m_file(filename, std::ios::binary)
+{
+    std::error_code ec;
+
+    m_size = fs::file_size(filename, ec);
+    m_isOpen = m_file.is_open() && !ec;
+}
+
+ChunkReader::ChunkReader(const std::string& filename, uint64_t size, std::string&& head) :
+    m_head(std::move(head)),
+    m_isOpen(true),
+    m_size(size)
+{
+    if (m_head.size() < m_size)
+    {
+        m_file.open(filename, std::ios::binary);
+        m_file.seekg(m_head.size());
+        m_isOpen = m_file.is_open() && m_file.good();
+    }
+}
+
+bool ChunkReader::next(uint64_t& offset, std::string& data, bool& isLast)
+{
+    if (!isOpen() || m_isSent || m_offset - m_acked >= FileTransfer::windowSize)
+    {
+        return false;
+    }
+
+    size_t count = 0;
+
+    if (m_head.size())
+    {
+        data.swap(m_head);
+        m_head = std::string();
+        count = data.size();
+    }
+    else
+    {
+        count = static_cast<size_t>(std::min<uint64_t>(FileTransfer::chunkSize, m_size - m_offset));
+
+        data.resize(count);
+        if (count && !m_file.read(data.data(), count))
+        {
+            m_isOpen = false;
+            return false;
+        }
+    }
+
+    offset = m_offset;
+    m_offset += count;
+    m_sha.update(data.data(), count);
+
+    // the empty file is sent as one empty chunk
+    isLast = m_offset >= m_size;
+    if (isLast)
+    {
+        m_digest = m_sha.final();
+        m_isSent = true;
+    }
+
+    return true;
+}
+
+ChunkWriter::ChunkWriter(const std::string& filename, const std::string& suffix) :
+    m_filename(filename),
+    m_partname(filename + suffix)
+{
+    std::error_code ec;
+
+    fs::create_directories(fs::path(filename).parent_path(), ec);
+    m_file = std::fopen(m_partname.c_str(), "wb");
+}
+
+ChunkWriter::~ChunkWriter()
+{
+    close();
+
+    if (m_isCommitted)
+    {
+        return;
+    }
+
+    std::error_code ec;
+
+    fs::remove(m_partname, ec);
+}
+
+void ChunkWriter::close()
+{
+    if (m_file)
+    {
+        std::fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+bool ChunkWriter::write(uint64_t offset, const std::string& data)
+{
+    if (!isOpen() || m_isFinished || offset != m_size)
+    {
+        return false;
+    }
+
+    if (std::fwrite(data.data(), 1, data.size(), m_file) != data.size())
+    {
+        return false;
+    }
+
+    m_size += data.size();
+    m_sha.update(data.data(), data.size());
+
+    return true;
+}
+
+bool ChunkWriter::finish(const std::string& digest)
+{
+    if (!finish())
+    {
+        return false;
+    }
+
+    m_isFinished = m_digest == digest;
+
+    return m_isFinished;
+}
+
+bool ChunkWriter::finish()
+{
+    if (!isOpen() || m_isFinished || m_digest.size())
+    {
+        return false;
+    }
+
+    // the file stays open until the commit, so it can be synced
+    m_digest = m_sha.final();
+    m_isFinished = !std::fflush(m_file) && !std::ferror(m_file);
+
+    return m_isFinished;
+}
+
+bool ChunkWriter::sync()
+{
+    return m_isFinished && isOpen() && !_commit(_fileno(m_file));
+}
+
+bool ChunkWriter::commit()
+{
+    if (!m_isFinished || m_isCommitted)
+    {
+        return false;
+    }
+
+    std::error_code ec;
+
+    close();
+    fs::rename(m_partname, m_filename, ec);
+    m_isCommitted = !ec;
+
+    return m_isCommitted;
+}
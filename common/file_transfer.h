@@ -0,0 +1,100 @@
+
+#pragma once
+
+#include <cstdio>
+#include <fstream>
+#include <stdint.h>
+#include <string>
+
+#include "sha256.h"
+
+namespace FileTransfer
+{
+
+const size_t chunkSize = 1024 * 1024;
+const uint64_t windowSize = 4 * chunkSize; // sent but not acknowledged bytes of one file
+
+// compression of the chunks, the daemon sends the mask of the supported codecs
+enum Codec : uint32_t
+{
+    Raw = 0,
+    Lz = 1,
+};
+
+const uint32_t codecs = 1 << Lz;
+
+// the best codec of the both sides
+Codec choose(uint32_t mask);
+
+// returns the codec of the out, it is Raw and the out is empty if the data is not compressible
+Codec pack(Codec codec, const std::string& data, std::string& out);
+bool unpack(uint32_t codec, const std::string& data, size_t rawSize, std::string& out);
+
+}
+
+// Reads the file by the chunks. The sender holds only one chunk in memory
+// and does not read ahead of the receiver more than the window
+class ChunkReader
+{
+public:
+    ChunkReader(const std::string& filename);
+    // the head is the first chunk of the file, it was read before. The small file is not opened
+    ChunkReader(const std::string& filename, uint64_t size, std::string&& head);
+    virtual ~ChunkReader() = default;
+
+    bool isOpen() const { return m_isOpen; }
+    uint64_t size() const { return m_size; }
+
+    // false, if the window is full or the whole file is sent
+    bool next(uint64_t& offset, std::string& data, bool& isLast);
+    void ack(uint64_t offset) { m_acked = std::max(m_acked, offset); }
+
+    bool isSent() const { return m_isSent; }
+    const std::string& digest() const { return m_digest; } // valid after the last chunk
+
+private:
+    std::ifstream m_file;
+    std::string m_head = "";
+    bool m_isOpen = false;
+    uint64_t m_size = 0;
+    uint64_t m_offset = 0;
+    uint64_t m_acked = 0;
+    bool m_isSent = false;
+    Sha256 m_sha;
+    std::string m_digest = "";
+};
+
+// Writes the chunks to the temporary file. The file gets its name after the digest is checked,
+// the unfinished file is deleted
+class ChunkWriter
+{
+public:
+    ChunkWriter(const std::string& filename, const std::string& suffix = ".part");
+    virtual ~ChunkWriter();
+
+    bool isOpen() const { return m_file != nullptr; }
+    uint64_t size() const { return m_size; }
+    const std::string& digest() const { return m_digest; }
+    const std::string& filename() const { return m_filename; }
+    bool isFinished() const { return m_isFinished; }
+
+    // the chunks go in order of the offset
+    bool write(uint64_t offset, const std::string& data);
+    bool finish(const std::string& digest);
+    bool finish(); // the data is trusted, the digest is not checked
+    bool sync(); // the finished file goes to the disk before it is renamed
+    bool commit();
+
+private:
+    void close();
+
+private:
+    std::string m_filename = "";
+    std::string m_partname = "";
+    std::FILE* m_file = nullptr;
+    uint64_t m_size = 0;
+    bool m_isFinished = false;
+    bool m_isCommitted = false;
+    Sha256 m_sha;
+    std::string m_digest = "";
+};
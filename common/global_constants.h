@@ -10,8 +10,19 @@ namespace Global
 const uint8_t versionMajor = 1;
 const uint8_t versionMinor = 3;
 
+// version of the tcp protocol, the daemon sends it in the Slave::Info
+const uint32_t protocolVersion = 8;
+const uint32_t protocolBatchTasks = 2; // Master::Packet.tasks is supported
+const uint32_t protocolInputCache = 3; // Master::Task.inputData may be omitted, Slave::Request is supported
+const uint32_t protocolStreaming = 4;  // the inputs and the outputs are sent by the chunks
+const uint32_t protocolBlobStore = 5;  // the task goes with the input hash only, the daemon requests the missing input
+const uint32_t protocolCompression = 6; // Slave::Info.codecs, the chunks may be compressed
+const uint32_t protocolManifest = 7;   // Master::Task.inputs, the daemon requests the missing blobs
+const uint32_t protocolOutputSet = 8;  // Master::Task.outputs, the other outputs are streamed by Chunk.file
+
 const uint16_t tcpDefaultPort = 1290;
 const uint16_t udpDefaultPort = 1291;
+const uint16_t tcpCoordinatorPort = 1292; // the consoles submit the build sets to the coordinator on the same host
 
 const std::string udpMulticastIp = "239.172.22.165";
 
@@ -0,0 +1,62 @@
+
+#define WIN32_LEAN_AND_MEAN
+
+#include "host_performance.h"
+
+#include <algorithm>
+#include <windows.h>
+
+#include "threadpool.h"
+
+namespace
+{
+    const uint32_t calibrationIterations = 5000000;
+    const uint32_t calibrationRuns = 3;
+    const double referenceIterationsPerMs = 100000.0;
+
+    int64_t nowMs()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+void HostPerformance::calibrate()
+{
+    double best = 0;
+
+    // the best of several runs, the host may be busy with other work
+    for (uint32_t run = 0; run < calibrationRuns; ++run)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        uint64_t x = 88172645463325252ull;
+        double f = 1.0;
+
+        for (uint32_t ii = 0; ii < calibrationIterations; ++ii)
+        {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            f = f * 1.0000001 + static_cast<double>(x & 0xff) * 1e-9;
+        }
+
+        volatile double sink = f + static_cast<double>(x);
+        (void)sink;
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        best = std::max(best, calibrationIterations / std::max(ms, 0.001));
+    }
+
+    MEMORYSTATUSEX memory;
+    memory.dwLength = sizeof(memory);
+
+    m_score = static_cast<float>(best / referenceIterationsPerMs);
+    m_cores = static_cast<uint32_t>(std::max(su::ThreadPool::getMaxThreads(), 1));
+    m_memory = GlobalMemoryStatusEx(&memory) ? memory.ullTotalPhys : 0;
+    m_calibrated = nowMs();
+}
+
+bool HostPerformance::isExpired(std::chrono::seconds period) const
+{
+    return nowMs() - m_calibrated >= std::chrono::duration_cast<std::chrono::milliseconds>(period).count();
+}
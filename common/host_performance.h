@@ -0,0 +1,27 @@
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+// Calibration of the host. The score is the normalised speed of one core, 1.0 is the reference machine
+class HostPerformance
+{
+public:
+    HostPerformance() = default;
+    virtual ~HostPerformance() = default;
+
+    void calibrate();
+    bool isExpired(std::chrono::seconds period) const;
+
+    float getScore() const { return m_score; }
+    uint32_t getCores() const { return m_cores; }
+    uint64_t getMemory() const { return m_memory; }
+
+private:
+    std::atomic<float> m_score = 1.0f;
+    std::atomic<uint32_t> m_cores = 1;
+    std::atomic<uint64_t> m_memory = 0;
+    std::atomic<int64_t> m_calibrated = 0; // steady clock, ms
+};
@@ -0,0 +1,209 @@
+
+#include "lz.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    const uint32_t hashLog = 14;
+    const size_t minMatch = 4;
+    const size_t maxOffset = 65535;
+    const size_t lastLiterals = 5;  // the block ends by the literals
+    const size_t matchMargin = 12;  // the last match starts before it
+    const size_t sampleSize = 4096;
+    const double sampleRatio = 0.9;
+
+    inline uint32_t read32(const uint8_t* ptr)
+    {
+        uint32_t value;
+
+        memcpy(&value, ptr, sizeof(value));
+        return value;
+    }
+
+    inline uint32_t hash(uint32_t value)
+    {
+        return (value * 2654435761u) >> (32 - hashLog);
+    }
+
+    void writeLength(std::string& out, size_t length)
+    {
+        while (length >= 255)
+        {
+            out.push_back(static_cast<char>(255));
+            length -= 255;
+        }
+
+        out.push_back(static_cast<char>(length));
+    }
+
+    bool readLength(const uint8_t* in, size_t size, size_t& pos, size_t& length)
+    {
+        uint8_t value = 255;
+
+        while (value == 255)
+        {
+            if (pos >= size)
+            {
+                return false;
+            }
+
+            value = in[pos++];
+            length += value;
+        }
+
+        return true;
+    }
+
+    void writeSequence(std::string& out, const uint8_t* literals, size_t countLiterals, size_t offset, size_t length)
+    {
+        size_t matchCode = length ? length - minMatch : 0;
+        uint8_t token = static_cast<uint8_t>((std::min<size_t>(countLiterals, 15) << 4) | std::min<size_t>(matchCode, 15));
+
+        out.push_back(static_cast<char>(token));
+        if (countLiterals >= 15)
+        {
+            writeLength(out, countLiterals - 15);
+        }
+
+        out.append(reinterpret_cast<const char*>(literals), countLiterals);
+
+        // the last sequence has no match
+        if (!length)
+        {
+            return;
+        }
+
+        out.push_back(static_cast<char>(offset & 0xff));
+        out.push_back(static_cast<char>(offset >> 8));
+
+        if (matchCode >= 15)
+        {
+            writeLength(out, matchCode - 15);
+        }
+    }
+}
+
+bool Lz::compress(const char* data, size_t size, std::string& out)
+{
+    thread_local std::vector<uint32_t> table(1 << hashLog);
+
+    auto in = reinterpret_cast<const uint8_t*>(data);
+    size_t anchor = 0;
+    size_t pos = 0;
+    size_t limit = size > matchMargin ? size - matchMargin : 0;
+
+    std::fill(table.begin(), table.end(), 0);
+    out.clear();
+    out.reserve(size + size / 255 + 16);
+
+    while (pos < limit)
+    {
+        uint32_t sequence = read32(in + pos);
+        uint32_t& entry = table[hash(sequence)];
+        size_t ref = entry;
+
+        entry = static_cast<uint32_t>(pos);
+
+        if (ref >= pos || pos - ref > maxOffset || read32(in + ref) != sequence)
+        {
+            ++pos;
+            continue;
+        }
+
+        size_t length = minMatch;
+        while (pos + length < size - lastLiterals && in[ref + length] == in[pos + length])
+        {
+            ++length;
+        }
+
+        writeSequence(out, in + anchor, pos - anchor, pos - ref, length);
+
+        pos += length;
+        anchor = pos;
+    }
+
+    writeSequence(out, in + anchor, size - anchor, 0, 0);
+
+    return out.size() < size;
+}
+
+bool Lz::decompress(const char* data, size_t size, size_t rawSize, std::string& out)
+{
+    auto in = reinterpret_cast<const uint8_t*>(data);
+    size_t pos = 0;
+    size_t outPos = 0;
+
+    out.resize(rawSize);
+
+    while (pos < size)
+    {
+        uint8_t token = in[pos++];
+        size_t countLiterals = token >> 4;
+
+        if (countLiterals == 15 && !readLength(in, size, pos, countLiterals))
+        {
+            return false;
+        }
+
+        if (countLiterals > size - pos || countLiterals > rawSize - outPos)
+        {
+            return false;
+        }
+
+        memcpy(out.data() + outPos, in + pos, countLiterals);
+        pos += countLiterals;
+        outPos += countLiterals;
+
+        if (pos == size)
+        {
+            break;
+        }
+
+        if (size - pos < 2)
+        {
+            return false;
+        }
+
+        size_t offset = in[pos] | (static_cast<size_t>(in[pos + 1]) << 8);
+        size_t length = token & 0x0f;
+
+        pos += 2;
+
+        if (length == 15 && !readLength(in, size, pos, length))
+        {
+            return false;
+        }
+
+        length += minMatch;
+
+        if (!offset || offset > outPos || length > rawSize - outPos)
+        {
+            return false;
+        }
+
+        // the match may overlap the output
+        char* dst = out.data() + outPos;
+        const char* src = dst - offset;
+
+        for (size_t ii = 0; ii < length; ++ii)
+        {
+            dst[ii] = src[ii];
+        }
+
+        outPos += length;
+    }
+
+    return outPos == rawSize;
+}
+
+bool Lz::isCompressible(const char* data, size_t size)
+{
+    std::string sample;
+
+    size = std::min(size, sampleSize);
+
+    return compress(data, size, sample) && sample.size() < size * sampleRatio;
+}
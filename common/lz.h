@@ -0,0 +1,20 @@
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+// The fast LZ77 codec in the LZ4 block format. The block has no header, the size of the raw data
+// is sent separately
+namespace Lz
+{
+
+// false, if the compressed block is not smaller than the data
+bool compress(const char* data, size_t size, std::string& out);
+bool decompress(const char* data, size_t size, size_t rawSize, std::string& out);
+
+// the text and the most of the assets are compressible, the packed and the encrypted data are not.
+// It is checked by the sample from the beginning of the data
+bool isCompressible(const char* data, size_t size);
+
+}
@@ -59,6 +59,15 @@ bool Projects::loadFromFile(const std::string& filename)
         return false;
     }
 
+    auto xmlPrefetch = root->FirstChildElement("Prefetch");
+    if (xmlPrefetch)
+    {
+        m_prefetch = static_cast<uint32_t>(std::max(std::atoi(xmlPrefetch->GetText()), 0));
+    }
+
+    loadInputCache(root->FirstChildElement("InputCache"));
+    loadMemoryDir(root->FirstChildElement("MemoryDir"));
+
     LOGSPN(m_log, "Loaded configuration '%s' was successful", filename.c_str());
 
     return true;
@@ -69,6 +78,19 @@ const Projects::Item* Projects::getProject(const std::string& prjname) const
     return m_items.contains(prjname) ? &m_items.at(prjname) : nullptr;
 }
 
+std::vector<std::string> Projects::getNames() const
+{
+    std::vector<std::string> out;
+
+    out.reserve(m_items.size());
+    for (const auto& [name, item] : m_items)
+    {
+        out.push_back(name);
+    }
+
+    return out;
+}
+
 uint32_t Projects::getFreeCore() const
 {
     int32_t coreReserved = 3;
@@ -146,3 +168,62 @@ bool Projects::loadWorkTime(const tinyxml2::XMLElement* root)
 
     return true;
 }
+
+void Projects::loadInputCache(const tinyxml2::XMLElement* root)
+{
+    // the blob store should be on the volume of the work directories, the inputs are hard linked from it
+    auto xmlDir = root ? root->FirstChildElement("Dir") : nullptr;
+
+    m_cacheDir = xmlDir && xmlDir->GetText() ? xmlDir->GetText() : "blobs";
+    m_cacheDir = su::String_replace(m_cacheDir, "/", "\\", true);
+    m_cacheDir = std::filesystem::absolute(m_cacheDir).string();
+    su::fs::addSeparator(m_cacheDir);
+
+    if (!root)
+    {
+        return;
+    }
+
+    auto xmlCount = root->FirstChildElement("Count");
+    if (xmlCount)
+    {
+        m_cacheCount = static_cast<uint32_t>(std::max(std::atoi(xmlCount->GetText()), 0));
+    }
+
+    // megabytes
+    auto xmlSize = root->FirstChildElement("Size");
+    if (xmlSize)
+    {
+        m_cacheSize = static_cast<uint64_t>(std::max(std::atoll(xmlSize->GetText()), 0ll)) << 20;
+    }
+}
+
+void Projects::loadMemoryDir(const tinyxml2::XMLElement* root)
+{
+    auto xmlDir = root ? root->FirstChildElement("Dir") : nullptr;
+
+    if (!xmlDir || !xmlDir->GetText())
+    {
+        return;
+    }
+
+    m_memoryDir = su::String_replace(xmlDir->GetText(), "/", "\\", true);
+    m_memoryDir = std::filesystem::absolute(m_memoryDir).string();
+    su::fs::addSeparator(m_memoryDir);
+
+    // megabytes
+    auto xmlSize = root->FirstChildElement("Size");
+    if (xmlSize)
+    {
+        m_memorySize = static_cast<uint64_t>(std::max(std::atoll(xmlSize->GetText()), 0ll)) << 20;
+    }
+
+    auto xmlMaxFile = root->FirstChildElement("MaxFile");
+    if (xmlMaxFile)
+    {
+        m_memoryMaxFile = static_cast<uint64_t>(std::max(std::atoll(xmlMaxFile->GetText()), 0ll)) << 20;
+    }
+
+    LOGSPN(m_log, "The task files up to %llu MB are placed to '%s', budget %llu MB",
+           m_memoryMaxFile >> 20, m_memoryDir.c_str(), m_memorySize >> 20);
+}
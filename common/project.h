@@ -31,11 +31,21 @@ public:
     bool loadFromFile(const std::string& filename);
 
     const Item* getProject(const std::string& prjname) const;
+    std::vector<std::string> getNames() const;
     uint32_t getFreeCore() const;
+    uint32_t getPrefetch() const { return m_prefetch; }
+    uint32_t getCacheCount() const { return m_cacheCount; }
+    uint64_t getCacheSize() const { return m_cacheSize; }
+    const std::string& getCacheDir() const { return m_cacheDir; }
+    const std::string& getMemoryDir() const { return m_memoryDir; }
+    uint64_t getMemorySize() const { return m_memorySize; }
+    uint64_t getMemoryMaxFile() const { return m_memoryMaxFile; }
 
 private:
     float getWorkPercent() const;
     bool loadWorkTime(const tinyxml2::XMLElement* root);
+    void loadInputCache(const tinyxml2::XMLElement* root);
+    void loadMemoryDir(const tinyxml2::XMLElement* root);
 
 protected:
     std::unordered_map<std::string, Item> m_items;
@@ -45,4 +55,14 @@ protected:
     size_t m_workEnd = 0;
     float m_workBath = 100;
     float m_workDefault = 100;
+
+    uint32_t m_prefetch = 2;
+    uint32_t m_cacheCount = 4096;
+    uint64_t m_cacheSize = 2048ull << 20;
+    std::string m_cacheDir = "";
+
+    // the RAM disk for the task files, it is not used if the dir is empty
+    std::string m_memoryDir = "";
+    uint64_t m_memorySize = 512ull << 20;
+    uint64_t m_memoryMaxFile = 16ull << 20;
 };
@@ -0,0 +1,170 @@
+
+#include "sha256.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    const uint32_t K[64] =
+    {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+
+    inline uint32_t rotr(uint32_t x, uint32_t n)
+    {
+        return (x >> n) | (x << (32 - n));
+    }
+}
+
+Sha256::Sha256()
+{
+    const uint32_t init[8] =
+    {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    memcpy(m_state, init, sizeof(m_state));
+}
+
+void Sha256::update(const void* data, size_t size)
+{
+    auto ptr = static_cast<const uint8_t*>(data);
+
+    m_length += size;
+
+    while (size)
+    {
+        size_t part = std::min(size, sizeof(m_block) - m_blockSize);
+
+        memcpy(m_block + m_blockSize, ptr, part);
+        m_blockSize += part;
+        ptr += part;
+        size -= part;
+
+        if (m_blockSize == sizeof(m_block))
+        {
+            transform(m_block);
+            m_blockSize = 0;
+        }
+    }
+}
+
+std::string Sha256::final()
+{
+    uint64_t bits = m_length * 8;
+    uint8_t pad = 0x80;
+
+    update(&pad, 1);
+
+    pad = 0;
+    while (m_blockSize != 56)
+    {
+        update(&pad, 1);
+    }
+
+    uint8_t length[8];
+    for (int ii = 0; ii < 8; ++ii)
+    {
+        length[ii] = static_cast<uint8_t>(bits >> (56 - ii * 8));
+    }
+    update(length, sizeof(length));
+
+    std::string out(digestSize, '\0');
+    for (size_t ii = 0; ii < 8; ++ii)
+    {
+        out[ii * 4 + 0] = static_cast<char>(m_state[ii] >> 24);
+        out[ii * 4 + 1] = static_cast<char>(m_state[ii] >> 16);
+        out[ii * 4 + 2] = static_cast<char>(m_state[ii] >> 8);
+        out[ii * 4 + 3] = static_cast<char>(m_state[ii]);
+    }
+
+    return out;
+}
+
+std::string Sha256::get(const std::string& data)
+{
+    Sha256 sha;
+
+    sha.update(data.data(), data.size());
+
+    return sha.final();
+}
+
+std::string Sha256::toHex(const std::string& digest)
+{
+    const char* hex = "0123456789abcdef";
+    std::string out;
+
+    out.reserve(digest.size() * 2);
+    for (auto ch : digest)
+    {
+        out.push_back(hex[(static_cast<uint8_t>(ch) >> 4) & 0x0f]);
+        out.push_back(hex[static_cast<uint8_t>(ch) & 0x0f]);
+    }
+
+    return out;
+}
+
+void Sha256::transform(const uint8_t* block)
+{
+    uint32_t w[64];
+
+    for (int ii = 0; ii < 16; ++ii)
+    {
+        w[ii] = (uint32_t(block[ii * 4]) << 24) | (uint32_t(block[ii * 4 + 1]) << 16) |
+                (uint32_t(block[ii * 4 + 2]) << 8) | uint32_t(block[ii * 4 + 3]);
+    }
+
+    for (int ii = 16; ii < 64; ++ii)
+    {
+        uint32_t s0 = rotr(w[ii - 15], 7) ^ rotr(w[ii - 15], 18) ^ (w[ii - 15] >> 3);
+        uint32_t s1 = rotr(w[ii - 2], 17) ^ rotr(w[ii - 2], 19) ^ (w[ii - 2] >> 10);
+
+        w[ii] = w[ii - 16] + s0 + w[ii - 7] + s1;
+    }
+
+    uint32_t a = m_state[0];
+    uint32_t b = m_state[1];
+    uint32_t c = m_state[2];
+    uint32_t d = m_state[3];
+    uint32_t e = m_state[4];
+    uint32_t f = m_state[5];
+    uint32_t g = m_state[6];
+    uint32_t h = m_state[7];
+
+    for (int ii = 0; ii < 64; ++ii)
+    {
+        uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + ch + K[ii] + w[ii];
+        uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + maj;
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    m_state[0] += a;
+    m_state[1] += b;
+    m_state[2] += c;
+    m_state[3] += d;
+    m_state[4] += e;
+    m_state[5] += f;
+    m_state[6] += g;
+    m_state[7] += h;
+}
@@ -0,0 +1,31 @@
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+// SHA-256 digest of the file content, it is the identity of the input data
+class Sha256
+{
+public:
+    static const size_t digestSize = 32;
+
+public:
+    Sha256();
+    virtual ~Sha256() = default;
+
+    void update(const void* data, size_t size);
+    std::string final(); // raw digest, digestSize bytes
+
+    static std::string get(const std::string& data);
+    static std::string toHex(const std::string& digest);
+
+private:
+    void transform(const uint8_t* block);
+
+private:
+    uint32_t m_state[8];
+    uint8_t m_block[64];
+    size_t m_blockSize = 0;
+    uint64_t m_length = 0;
+};
@@ -0,0 +1,61 @@
+
+#include "wildcard.h"
+
+#include <cctype>
+
+namespace
+{
+    inline bool isSeparator(char c)
+    {
+        return c == '\\' || c == '/';
+    }
+
+    inline bool isSame(char a, char b)
+    {
+        return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+    }
+}
+
+bool Wildcard::isMask(const std::string& mask)
+{
+    return mask.find_first_of("*?") != std::string::npos;
+}
+
+bool Wildcard::isMatch(const std::string& name, const std::string& mask)
+{
+    size_t pos = 0;
+    size_t maskPos = 0;
+    size_t star = std::string::npos;
+    size_t mark = 0;
+
+    while (pos < name.size())
+    {
+        if (maskPos < mask.size() && mask[maskPos] == '*')
+        {
+            star = maskPos++;
+            mark = pos;
+        }
+        else if (maskPos < mask.size() && (mask[maskPos] == '?' ? !isSeparator(name[pos]) : isSame(mask[maskPos], name[pos])))
+        {
+            ++pos;
+            ++maskPos;
+        }
+        else if (star != std::string::npos && !isSeparator(name[mark]))
+        {
+            // the star takes one more char
+            maskPos = star + 1;
+            pos = ++mark;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    while (maskPos < mask.size() && mask[maskPos] == '*')
+    {
+        ++maskPos;
+    }
+
+    return maskPos == mask.size();
+}
@@ -0,0 +1,14 @@
+
+#pragma once
+
+#include <string>
+
+// The masks of the file names, '*' is any sequence and '?' is any char, the case is ignored.
+// The wildcards do not match the path separators, so the mask of the dir does not match its subdirs
+namespace Wildcard
+{
+
+bool isMask(const std::string& mask);
+bool isMatch(const std::string& name, const std::string& mask);
+
+}
@@ -0,0 +1,197 @@
+
+#include "action_cache.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "fileex.h"
+#include "log.h"
+
+#include "console.h"
+#include "sha256.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const std::string indexName = "index";
+}
+
+ActionCache::ActionCache(const std::string& dir, uint64_t maxSize) :
+    m_dir(dir),
+    m_maxSize(maxSize)
+{
+    su::fs::addSeparator(m_dir);
+}
+
+std::string ActionCache::key(const TaskInfo& task) const
+{
+    Sha256 sha;
+
+    auto add = [&sha](const std::string& value)
+    {
+        sha.update(value.c_str(), value.size() + 1);
+    };
+
+    // the application is identified by its content, the other version of the tool gives the other key
+    if (task.m_toolHash.empty())
+    {
+        return "";
+    }
+
+    add(task.m_message.project());
+    add(task.m_message.application());
+    add(task.m_toolHash);
+    add(task.m_message.commandline());
+    add(task.m_message.workingdir());
+    add(task.m_message.sourcefile());
+    add(task.m_message.outputfile());
+    add(task.m_inputHash);
+
+    for (const auto& input : task.m_message.inputs())
+    {
+        add(input.file());
+        add(input.hash());
+    }
+
+    // the dependencies may write the other inputs of the task, the task is not cached without their keys
+    for (auto dependency : task.m_dependencies)
+    {
+        if (dependency->m_actionKey.empty())
+        {
+            return "";
+        }
+
+        add(dependency->m_actionKey);
+    }
+
+    return Sha256::toHex(sha.final());
+}
+
+std::string ActionCache::toolPath(const TaskInfo& task)
+{
+    fs::path application = task.m_vars.replace(task.m_message.application());
+
+    if (application.is_relative())
+    {
+        application = fs::path(task.m_vars.replace(task.m_message.workingdir())) / application;
+    }
+
+    return application.string();
+}
+
+bool ActionCache::load()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    std::error_code ec;
+
+    fs::create_directories(m_dir, ec);
+
+    std::ifstream file(m_dir + indexName);
+
+    if (!file.is_open())
+    {
+        LOGW("The action cache index '%s' not found", (m_dir + indexName).c_str());
+        return false;
+    }
+
+    // size, key. The entries without the file are dropped
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream ss(line);
+        Item item;
+
+        if (!(ss >> item.m_size >> item.m_key) || m_index.contains(item.m_key) || !fs::exists(entryName(item.m_key), ec))
+        {
+            continue;
+        }
+
+        m_items.push_back(item);
+        m_index[item.m_key] = std::prev(m_items.end());
+        m_size += item.m_size;
+    }
+
+    LOGN("Loaded %u items of the action cache '%s', %llu MB", m_items.size(), m_dir.c_str(), m_size >> 20);
+
+    evict();
+    return true;
+}
+
+bool ActionCache::save() const
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    std::ofstream file(m_dir + indexName, std::ios::trunc);
+
+    if (!file.is_open())
+    {
+        LOGE("Can not save the action cache index '%s'", (m_dir + indexName).c_str());
+        return false;
+    }
+
+    for (const auto& item : m_items)
+    {
+        file << item.m_size << "\t" << item.m_key << "\n";
+    }
+
+    return true;
+}
+
+std::string ActionCache::find(const std::string& key)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    auto it = m_index.find(key);
+
+    if (it == m_index.end())
+    {
+        ++m_countMisses;
+        return "";
+    }
+
+    m_items.splice(m_items.begin(), m_items, it->second);
+
+    return entryName(key);
+}
+
+void ActionCache::restored(bool isRestored)
+{
+    ++(isRestored ? m_countHits : m_countMisses);
+}
+
+void ActionCache::store(const std::string& key, const std::string& filename)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    std::error_code ec;
+
+    if (m_index.contains(key))
+    {
+        return;
+    }
+
+    auto size = fs::file_size(filename, ec);
+    if (ec || !fs::copy_file(filename, entryName(key), fs::copy_options::overwrite_existing, ec) || ec)
+    {
+        LOGW("Can not store '%s' to the action cache", filename.c_str());
+        return;
+    }
+
+    m_items.push_front({key, size});
+    m_index[key] = m_items.begin();
+    m_size += size;
+
+    evict();
+}
+
+void ActionCache::evict()
+{
+    while (m_items.size() && m_size > m_maxSize)
+    {
+        auto& item = m_items.back();
+
+        su::fs::deleteFile(entryName(item.m_key));
+        m_size -= item.m_size;
+        m_index.erase(item.m_key);
+        m_items.pop_back();
+    }
+}
@@ -0,0 +1,62 @@
+
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+struct TaskInfo;
+
+// Outputs of the successful tasks by the hash of the application content, the command line, the working directory
+// and the input content. The task with the known key is not dispatched, its output is copied from the cache.
+// The index is the list of the keys, the last used is at the front. It is thread safe,
+// the server finds the outputs and the main thread stores them when the build is finished.
+// The output is copied by the output writer of the server, the application is hashed by the read-ahead
+class ActionCache
+{
+    struct Item
+    {
+        std::string m_key; // hex
+        uint64_t m_size = 0;
+    };
+
+public:
+    ActionCache(const std::string& dir, uint64_t maxSize);
+    virtual ~ActionCache() = default;
+
+    // the input hash, the application hash of the task and the keys of its dependencies must be calculated.
+    // The key is empty, if the application is not read on this host, the task is not cached then
+    std::string key(const TaskInfo& task) const;
+    static std::string toolPath(const TaskInfo& task);
+
+    bool load();
+    bool save() const;
+
+    // the file of the cached output, it is empty if the key is not known
+    std::string find(const std::string& key);
+    // the found output is copied or it is failed
+    void restored(bool isRestored);
+    void store(const std::string& key, const std::string& filename);
+
+    uint64_t countHits() const { return m_countHits; }
+    uint64_t countMisses() const { return m_countMisses; }
+
+private:
+    void evict();
+    std::string entryName(const std::string& key) const { return m_dir + key; }
+
+private:
+    mutable std::mutex m_mutex;
+    std::string m_dir = "";
+    uint64_t m_maxSize = 0;
+    uint64_t m_size = 0;
+
+    std::list<Item> m_items;
+    std::unordered_map<std::string, std::list<Item>::iterator> m_index;
+
+    std::atomic<uint64_t> m_countHits = 0;
+    std::atomic<uint64_t> m_countMisses = 0;
+};
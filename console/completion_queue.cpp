@@ -0,0 +1,70 @@
+
+#include "completion_queue.h"
+
+CompletionQueue::CompletionQueue()
+{
+    m_headBlock = new Block;
+    m_tailBlock = m_headBlock;
+}
+
+CompletionQueue::~CompletionQueue()
+{
+    while (m_headBlock)
+    {
+        auto next = m_headBlock->m_next.load();
+
+        delete m_headBlock;
+        m_headBlock = next;
+    }
+}
+
+void CompletionQueue::push(Item&& item)
+{
+    if (m_tailIndex == blockSize)
+    {
+        auto block = new Block;
+
+        m_tailBlock->m_next.store(block, std::memory_order_release);
+        m_tailBlock = block;
+        m_tailIndex = 0;
+    }
+
+    m_tailBlock->m_items[m_tailIndex++] = std::move(item);
+    m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    m_signal.release();
+}
+
+bool CompletionQueue::wait(std::vector<Item>& out, std::chrono::milliseconds timeout)
+{
+    out.clear();
+
+    if (!m_signal.try_acquire_for(timeout))
+    {
+        return false;
+    }
+
+    // the block is linked before its first item is published
+    size_t tail = m_tail.load(std::memory_order_acquire);
+
+    for (; m_head != tail; ++m_head)
+    {
+        if (m_headIndex == blockSize)
+        {
+            auto next = m_headBlock->m_next.load(std::memory_order_acquire);
+
+            delete m_headBlock;
+            m_headBlock = next;
+            m_headIndex = 0;
+        }
+
+        out.push_back(std::move(m_headBlock->m_items[m_headIndex++]));
+    }
+
+    // one signal is taken for all the read items, the rest are dropped.
+    // The signal of an item read before its release wakes up the consumer with no items, it is harmless
+    for (size_t ii = 1; ii < out.size() && m_signal.try_acquire(); ++ii)
+    {
+    }
+
+    return !out.empty();
+}
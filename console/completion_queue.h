@@ -0,0 +1,57 @@
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <semaphore>
+#include <string>
+#include <vector>
+
+#include "win/process.h"
+
+// The final results of the tasks, pushed by the server thread and waited by the main thread.
+// Single producer, single consumer queue of the linked blocks, the count of tasks is not known while they are generated.
+// Only the producer links the blocks and only the consumer deletes them. The semaphore only wakes up the consumer
+class CompletionQueue
+{
+public:
+    struct Item
+    {
+        uint32_t m_id = 0;
+        uint32_t m_build = 0;
+        std::string m_doneIp = "";
+        su::Process::ExitCodeResult m_result = su::Process::ExitCodeResult::NoInit;
+        int32_t m_exitCode = 0;
+    };
+
+public:
+    CompletionQueue();
+    virtual ~CompletionQueue();
+
+    // the producer side
+    void push(Item&& item);
+
+    // the consumer side, moves all items to the out, returns false if there are no items during the timeout
+    bool wait(std::vector<Item>& out, std::chrono::milliseconds timeout);
+
+private:
+    static const size_t blockSize = 256;
+
+    struct Block
+    {
+        Item m_items[blockSize];
+        std::atomic<Block*> m_next = nullptr;
+    };
+
+    // the consumer side
+    Block* m_headBlock = nullptr;
+    size_t m_headIndex = 0;
+    size_t m_head = 0;
+
+    // the producer side
+    Block* m_tailBlock = nullptr;
+    size_t m_tailIndex = 0;
+    alignas(64) std::atomic<size_t> m_tail = 0; // count of the pushed items
+
+    std::counting_semaphore<> m_signal{0};
+};
@@ -5,7 +5,12 @@
 #include <chrono>
 #include <filesystem>
 #include <vector>
-#include <mutex>
+#include <deque>
+#include <functional>
+#include <queue>
+#include <set>
+#include <sstream>
+#include <thread>
 #include <unordered_map>
 
 #pragma warning(disable:4267)
@@ -23,8 +28,14 @@
 
 #include "project.h"
 #include "global_constants.h"
+#include "sha256.h"
 #include "whoishere.h"
 
+#include "action_cache.h"
+#include "coordinator_client.h"
+#include "coordinator_server.h"
+#include "task_graph.h"
+#include "task_history.h"
 #include "tcp_protobufnode.h"
 #include "tcp_protobufserver.h"
 
@@ -40,8 +51,26 @@ namespace Arg
     const su::CommandLineOption SFILE =  { "sfile",  's' };
     const su::CommandLineOption LOG =    { "log"  ,  'l' };
     const su::CommandLineOption WAIT =   { "wait" ,  'w' };
+    const su::CommandLineOption HISTORY = { "history", 'H' };
+    const su::CommandLineOption SPECULATE = { "speculate", 'x' };
+    const su::CommandLineOption RETRY = { "retry", 'r' };
+    const su::CommandLineOption QUARANTINE = { "quarantine", 'q' };
+    const su::CommandLineOption LOCAL = { "local", 'L' };
+    const su::CommandLineOption WEIGHTED = { "weighted", 'g' };
+    const su::CommandLineOption SERVE = { "serve", 'v' };
+    const su::CommandLineOption SUBMIT = { "submit", 'u' };
+    const su::CommandLineOption CACHE = { "cache", 'a' };
+    const su::CommandLineOption CACHESIZE = { "cachesize", 'z' };
+    const su::CommandLineOption NOCACHE = { "nocache", 'n' };
 };
 
+namespace
+{
+    const std::chrono::milliseconds renderPeriod(250);
+    const std::chrono::seconds broadcastPeriod(30);
+    const std::chrono::seconds pingPeriod(10);
+}
+
 namespace su
 {
 namespace Terminal
@@ -62,88 +91,165 @@ namespace Global
     su::Crc32 crc32;
 }
 
-bool taskGenerator(const tinyxml2::XMLElement* element, const TaskVariables& vars, std::vector<TaskInfo>& tasks, uint32_t& id)
+// the task is ready to dispatch, it is called from the generator thread
+using TaskReady = std::function<void(TaskInfo&)>;
+
+// the items are separated by ';'
+std::vector<std::string> splitList(const std::string& list)
+{
+    std::vector<std::string> out;
+    std::istringstream stream(list);
+
+    for (std::string token; std::getline(stream, token, ';'); )
+    {
+        token.erase(0, token.find_first_not_of(" \t"));
+        token.erase(token.find_last_not_of(" \t") + 1);
+
+        if (!token.empty())
+        {
+            out.push_back(token);
+        }
+    }
+
+    return out;
+}
+
+// the pattern is 'dir\*suffix', the names of the found files are in the lower case
+std::vector<std::string> findFiles(const std::string& pattern)
 {
-    std::vector<TaskInfo> out;
+    auto posLastSlash = pattern.rfind('\\');
 
+    std::string dir = posLastSlash != std::string::npos ? pattern.substr(0, posLastSlash) : ".\\";
+    std::string mask = su::String_tolower(posLastSlash != std::string::npos ? pattern.substr(posLastSlash + 2) : pattern);
+    std::vector<std::string> out;
+    std::error_code ec;
+
+    // the iteration does not throw, the error stops it
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+    {
+        std::string filename = su::String_tolower(it->path().string());
+
+        if (filename.size() >= mask.size() && filename.substr(filename.size() - mask.size()) == mask)
+        {
+            out.push_back(filename);
+        }
+    }
+
+    // the task runs without these inputs, the tool reports the error
+    if (ec)
+    {
+        LOGW("Can not list the inputs '%s': %s", pattern.c_str(), ec.message().c_str());
+    }
+
+    return out;
+}
+
+bool taskGenerator(const tinyxml2::XMLElement* element, const TaskVariables& vars, std::deque<TaskInfo>& tasks, std::atomic<uint32_t>& id,
+                   const TaskReady& onReady)
+{
     auto sourceFile = su::tinyxml2::getAttributeString(element, "SourceFile", "", true);
     auto outputFile = su::tinyxml2::getAttributeString(element, "OutputFile", "", true);
     auto application = su::tinyxml2::getAttributeString(element, "Application", "", true);
     auto params = su::tinyxml2::getAttributeString(element, "Params", "", true);
     auto workingDir = su::tinyxml2::getAttributeString(element, "WorkingDir", "", true);
     bool isAbortOnError = su::tinyxml2::getAttributeBool(element, "AbortOnError", true);
+    auto name = su::tinyxml2::getAttributeString(element, "Name", "", true);
+    auto dependsOn = su::tinyxml2::getAttributeString(element, "DependsOn", "", true);
+    auto inputs = su::tinyxml2::getAttributeString(element, "Inputs", "", true);
+    auto outputs = su::tinyxml2::getAttributeString(element, "Outputs", "", true);
 
     sourceFile = su::String_replace(sourceFile, "/", "\\", true);
     outputFile = su::String_replace(outputFile, "/", "\\", true);
     application = su::String_replace(application, "/", "\\", true);
     params = su::String_replace(params, "/", "\\", true);
     workingDir = su::String_replace(workingDir, "/", "\\", true);
+    inputs = su::String_replace(inputs, "/", "\\", true);
+    outputs = su::String_replace(outputs, "/", "\\", true);
 
-    if (sourceFile.find('*') != std::string::npos)
-    {
-        auto posLastSlash = sourceFile.rfind('\\');
-        std::string sourceDir = posLastSlash != std::string::npos ? sourceFile.substr(0, posLastSlash + 1) : ".\\";
-
-        sourceFile = vars.replace(sourceFile);
-        posLastSlash = sourceFile.rfind('\\');
+    // the id, the name or the output file of other tasks, separated by ';'
+    std::vector<std::string> dependencies;
 
-        std::string dir = posLastSlash != std::string::npos ? sourceFile.substr(0, posLastSlash) : ".\\";
-        std::string mask = su::String_tolower(posLastSlash != std::string::npos ? sourceFile.substr(posLastSlash + 2) : sourceFile);
-
-        for (const auto& entry : fs::directory_iterator(dir))
-        {
-            std::string filename = su::String_tolower(entry.path().string());
+    for (const auto& token : splitList(dependsOn))
+    {
+        dependencies.push_back(su::String_replace(vars.replace(token), "/", "\\", true));
+    }
 
-            if (filename.substr(filename.size() - mask.size()) == mask)
-            {
-                TaskInfo mti(++id);
+    // the other input files or the masks, they may use the variables of the task.
+    // The mask is listed once for all tasks with the same one
+    auto inputList = splitList(inputs);
+    std::unordered_map<std::string, std::vector<std::string>> masks;
 
-                mti.m_vars = vars;
-                mti.m_vars.SourceFile = filename;
-                mti.m_vars.OutputFile = outputFile;
+    // the other output files or the masks, they are collected in the work dir after the process
+    auto outputList = splitList(outputs);
 
-                out.push_back(mti);
-            }
-        }
-    }
-    else
+    // every task is dispatched as soon as it is created, the directory is not enumerated before
+    auto createTask = [&](const std::string& filename)
     {
-        TaskInfo mti(++id);
+        TaskInfo& task = tasks.emplace_back(++id);
 
-        mti.m_vars = vars;
-        mti.m_vars.SourceFile = sourceFile;
-        mti.m_vars.OutputFile = outputFile;
+        task.m_vars = vars;
+        task.m_vars.SourceFile = filename;
+        task.m_vars.OutputFile = outputFile;
+        task.m_name = name;
+        task.m_dependsOn = dependencies;
 
-        out.push_back(mti);
-    }
-
-    for (auto& task : out)
-    {
         // step 1. processing the source file and raw name
         task.m_vars.SourceFile = task.m_vars.replace(task.m_vars.SourceFile);
         task.m_vars.SourceFileName = su::String_rawFilename(fs::path(task.m_vars.SourceFile).filename().string());
 
-        // step 2. processing the output file name
+        // step 2. processing the output file name and the other inputs
         task.m_vars.OutputFile = task.m_vars.replace(task.m_vars.OutputFile);
 
+        for (const auto& input : inputList)
+        {
+            auto path = task.m_vars.replace(input);
+
+            if (path.find('*') == std::string::npos)
+            {
+                task.m_inputs.push_back(path);
+                continue;
+            }
+
+            auto it = masks.find(path);
+            if (it == masks.end())
+            {
+                it = masks.emplace(path, findFiles(path)).first;
+            }
+
+            task.m_inputs.insert(task.m_inputs.end(), it->second.begin(), it->second.end());
+        }
+
         // step 3. convert absolute paths to project related paths
         auto curCommandline = task.m_vars.replace(params);
         auto curWorkingDir = task.m_vars.replace(workingDir);
 
-        sourceFile = su::String_replace(task.m_vars.SourceFile, task.m_vars.PDir, "$(pdir)", true);
-        outputFile = su::String_replace(task.m_vars.OutputFile, task.m_vars.PDir, "$(pdir)", true);
+        auto curSourceFile = su::String_replace(task.m_vars.SourceFile, task.m_vars.PDir, "$(pdir)", true);
+        auto curOutputFile = su::String_replace(task.m_vars.OutputFile, task.m_vars.PDir, "$(pdir)", true);
         curCommandline = su::String_replace(curCommandline, task.m_vars.PDir, "$(pdir)", true);
         curWorkingDir = su::String_replace(curWorkingDir, task.m_vars.PDir, "$(pdir)", true);
 
         // step 4. create the protobuf message
         task.m_message.set_project(task.m_vars.PName);
-        task.m_message.set_sourcefile(sourceFile);
-        task.m_message.set_outputfile(outputFile);
+        task.m_message.set_sourcefile(curSourceFile);
+        task.m_message.set_outputfile(curOutputFile);
         task.m_message.set_application(task.m_vars.replace(application));
         task.m_message.set_commandline(curCommandline);
         task.m_message.set_workingdir(curWorkingDir);
         task.m_message.set_abortonerror(isAbortOnError);
 
+        for (const auto& output : outputList)
+        {
+            auto curOutput = su::String_replace(task.m_vars.replace(output), task.m_vars.PDir, "$(pdir)", true);
+
+            if (fs::path(curOutput).is_absolute())
+            {
+                LOGW("The output '%s' of task %u is not in the project dir, it is ignored", curOutput.c_str(), task.m_message.id());
+                continue;
+            }
+
+            task.m_message.add_outputs(curOutput.starts_with("$(pdir)") ? curOutput : "$(pdir)" + curOutput);
+        }
+
         LOGD("Task %u: '%s\\%s %s', '%s' ==> '%s'",
              task.m_message.id(),
              task.m_message.workingdir().c_str(),
@@ -151,31 +257,86 @@ bool taskGenerator(const tinyxml2::XMLElement* element, const TaskVariables& var
              task.m_message.commandline().c_str(),
              task.m_message.sourcefile().c_str(),
              task.m_message.outputfile().c_str());
-    }
 
-    if (out.size())
+        if (onReady)
+        {
+            onReady(task);
+        }
+    };
+
+    if (sourceFile.find('*') != std::string::npos)
+    {
+        for (const auto& filename : findFiles(vars.replace(sourceFile)))
+        {
+            createTask(filename);
+        }
+    }
+    else
     {
-        tasks.insert(tasks.end(), out.begin(), out.end());
+        createTask(sourceFile);
     }
 
     return true;
 }
 
-bool loadConfig(const std::string& filename, const Projects& projects, const TaskVariables& vars, std::vector<TaskInfo>& tasks)
+const tinyxml2::XMLElement* loadBuildSet(const std::string& filename, tinyxml2::XMLDocument& doc)
 {
-    tinyxml2::XMLDocument doc;
-    uint32_t id = 0;
-
     if (tinyxml2::XML_SUCCESS != doc.LoadFile(filename.c_str()))
     {
         LOGE("Loading configuration '%s' failed: %s", filename.c_str(), doc.ErrorStr());
-        return false;
+        return nullptr;
     }
 
     auto root = doc.FirstChildElement("BuildSet");
     if (!root)
     {
         LOGE("Loading configuration '%s' failed: can not found the `BuildSet` root element", filename.c_str());
+        return nullptr;
+    }
+
+    return root;
+}
+
+// the known projects for the broadcast and the presence of the dependencies, before the tasks are generated
+bool scanConfig(const std::string& filename, const Projects& projects, std::set<std::string>& prjNames, bool& isGraph)
+{
+    tinyxml2::XMLDocument doc;
+    auto root = loadBuildSet(filename, doc);
+
+    if (!root)
+    {
+        return false;
+    }
+
+    isGraph = false;
+
+    for (auto project = root->FirstChildElement("Project"); project; project = project->NextSiblingElement("Project"))
+    {
+        std::string prjName = su::tinyxml2::getAttributeString(project, "Name", "", true);
+
+        if (projects.getProject(prjName))
+        {
+            prjNames.insert(prjName);
+        }
+
+        for (auto element = project->FirstChildElement("Task"); element != nullptr; element = element->NextSiblingElement("Task"))
+        {
+            isGraph = isGraph || element->Attribute("DependsOn");
+        }
+    }
+
+    return true;
+}
+
+// the ids are unique in the coordinator, so they are shared by the build sets
+bool loadConfig(const std::string& filename, const Projects& projects, const TaskVariables& vars, std::deque<TaskInfo>& tasks,
+                std::atomic<uint32_t>& id, const TaskReady& onReady)
+{
+    tinyxml2::XMLDocument doc;
+    auto root = loadBuildSet(filename, doc);
+
+    if (!root)
+    {
         return false;
     }
 
@@ -198,7 +359,7 @@ bool loadConfig(const std::string& filename, const Projects& projects, const Tas
 
         for (auto element = project->FirstChildElement("Task"); element != nullptr; element = element->NextSiblingElement("Task"))
         {
-            if (!taskGenerator(element, prjVars, tasks, id))
+            if (!taskGenerator(element, prjVars, tasks, id, onReady))
             {
                 return false;
             }
@@ -218,6 +379,87 @@ bool loadConfig(const std::string& filename, const Projects& projects, const Tas
     return tasks.size();
 }
 
+// the weight of the task without the expected time, ms. The expected time stays unknown for the speculation
+const uint32_t defaultTaskTime = 1000;
+
+// longest expected tasks go first, the time per byte of the history is used for the new tasks.
+// Returns true if the task is known by the history
+bool predictTask(const TaskHistory& history, double timePerByte, TaskInfo& task)
+{
+    std::error_code ec;
+    auto size = fs::file_size(task.m_vars.SourceFile, ec);
+    auto item = history.get(TaskHistory::key(task.m_message));
+
+    task.m_inputSize = ec ? 0 : size;
+
+    if (item)
+    {
+        task.m_expected = item->m_duration;
+        task.m_affinity = item->m_host;
+        task.m_affinityHash = item->m_hash;
+    }
+    else
+    {
+        task.m_expected = static_cast<uint32_t>(task.m_inputSize * timePerByte);
+    }
+
+    task.m_priority = task.m_expected ? task.m_expected : defaultTaskTime;
+
+    return item != nullptr;
+}
+
+// list scheduling of the expected times on the given slots, in the dispatch order. The dependencies are ignored
+uint32_t predictMakespan(const std::deque<TaskInfo>& tasks, size_t slots)
+{
+    if (!slots)
+    {
+        return 0;
+    }
+
+    std::vector<const TaskInfo*> order;
+    order.reserve(tasks.size());
+    for (const auto& task : tasks)
+    {
+        order.push_back(&task);
+    }
+
+    std::sort(order.begin(), order.end(), [](const TaskInfo* a, const TaskInfo* b)
+    {
+        return a->m_priority != b->m_priority ? a->m_priority > b->m_priority : a->m_message.id() < b->m_message.id();
+    });
+
+    std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<uint64_t>> loads;
+    uint64_t makespan = 0;
+
+    for (size_t ii = 0; ii < slots; ++ii)
+    {
+        loads.push(0);
+    }
+
+    for (auto task : order)
+    {
+        uint64_t load = loads.top() + task->m_expected;
+
+        loads.pop();
+        loads.push(load);
+        makespan = std::max(makespan, load);
+    }
+
+    return static_cast<uint32_t>(makespan);
+}
+
+void updateHistory(TaskHistory& history, const std::deque<TaskInfo>& tasks)
+{
+    for (const auto& task : tasks)
+    {
+        if (task.m_result == su::Process::ExitCodeResult::Exited && !task.m_exitCode && task.m_duration)
+        {
+            history.set(TaskHistory::key(task.m_message), task.m_duration, task.m_inputSize,
+                        task.m_doneHost, Sha256::toHex(task.m_inputHash));
+        }
+    }
+}
+
 // send upd datagramm
 bool sendBroadcast(const std::string& prjName)
 {
@@ -255,6 +497,467 @@ bool sendBroadcast(const std::string& prjName)
     return !fault;
 }
 
+// the counters of the results and their view in the terminal
+struct Progress
+{
+    struct Host
+    {
+        size_t m_success = 0;
+        size_t m_errors = 0;
+    };
+
+    void add(const std::string& doneIp, su::Process::ExitCodeResult result, int32_t exitCode)
+    {
+        ++m_countDone;
+        m_isChanged = true;
+
+        if (result == su::Process::ExitCodeResult::NotStarted)
+        {
+            ++m_hosts[doneIp].m_errors;
+            ++m_countError;
+        }
+
+        if (result == su::Process::ExitCodeResult::Exited)
+        {
+            if (exitCode)
+            {
+                ++m_hosts[doneIp].m_errors;
+                ++m_countError;
+            }
+            else
+            {
+                ++m_hosts[doneIp].m_success;
+                ++m_countSuccess;
+            }
+        }
+    }
+
+    // the terminal is redrawn by the results, but not more often than renderPeriod
+    void render(size_t countTasks, bool isForce)
+    {
+        auto now = std::chrono::steady_clock::now();
+
+        if (!m_isChanged || (!isForce && now - m_lastRender < renderPeriod))
+        {
+            return;
+        }
+
+        su::Terminal::setCursor(0, 1);
+
+        for (const auto& [ip, value]: m_hosts)
+        {
+            printf("%19s | %llu/%llu/%llu          \n",
+                   ip.c_str(), value.m_errors, value.m_success, value.m_errors + value.m_success);
+        }
+        printf("total               | %llu/%llu/%llu %3.1f%%\n",
+               m_countError, m_countSuccess, countTasks,
+               countTasks ? double(m_countDone) / countTasks * 100.0 : 0.0);
+
+        m_lastRender = now;
+        m_isChanged = false;
+    }
+
+    std::unordered_map<std::string, Host> m_hosts;
+    size_t m_countDone = 0;
+    size_t m_countError = 0;
+    size_t m_countSuccess = 0;
+    bool m_isChanged = true;
+    std::chrono::steady_clock::time_point m_lastRender;
+};
+
+// The tasks of one build set, they are generated on the own thread while the server dispatches them.
+// The graph needs all tasks, so the build set with dependencies is submitted after the generation
+struct BuildSet
+{
+    bool isFinished() const
+    {
+        return m_isFailed || (m_isGenerated && m_progress.m_countDone >= m_countTasks);
+    }
+
+    uint32_t m_id = 0;
+    std::string m_client = ""; // the console of the coordinator
+    std::string m_config = "";
+    bool m_isGraph = false;
+    TaskVariables m_vars;
+    TaskHistory m_history; // the snapshot for the generator thread
+    std::deque<TaskInfo> m_tasks; // the server keeps the pointers, the deque does not move the elements
+    TaskGraph m_graph;
+    Progress m_progress;
+    std::chrono::steady_clock::time_point m_startTime;
+
+    std::atomic<size_t> m_countTasks = 0;
+    std::atomic_bool m_isGenerated = false;
+    std::atomic_bool m_isFailed = false;
+    std::thread m_generator;
+};
+
+void startGenerator(BuildSet& build, const Projects& projects, TcpProtobufServer& server, std::atomic<uint32_t>& ids)
+{
+    build.m_generator = std::thread([&build, &projects, &server, &ids]()
+    {
+        double timePerByte = build.m_history.getTimePerByte();
+        size_t countKnown = 0;
+
+        bool result = loadConfig(build.m_config, projects, build.m_vars, build.m_tasks, ids, [&](TaskInfo& task)
+        {
+            task.m_build = build.m_id;
+            countKnown += predictTask(build.m_history, timePerByte, task);
+
+            if (!build.m_isGraph)
+            {
+                ++build.m_countTasks;
+                server.submit(&task);
+            }
+        });
+
+        LOGN("Predicted %llu tasks, %llu of them by the history", build.m_tasks.size(), countKnown);
+
+        if (result && build.m_isGraph)
+        {
+            result = build.m_graph.build(build.m_tasks);
+
+            for (size_t ii = 0; result && ii < build.m_tasks.size(); ++ii)
+            {
+                ++build.m_countTasks;
+                server.submit(&build.m_tasks[ii]);
+            }
+        }
+
+        build.m_isFailed = !result;
+        build.m_isGenerated = true;
+        server.setGenerated(build.m_id);
+    });
+}
+
+// the outputs of the executed successful tasks, the restored ones are in the cache already
+void updateActionCache(ActionCache& cache, const std::deque<TaskInfo>& tasks)
+{
+    for (const auto& task : tasks)
+    {
+        // the cache keeps one output file
+        if (task.m_state == TaskState::Done && !task.m_isCached && !task.m_actionKey.empty() && !task.m_message.outputs_size())
+        {
+            cache.store(task.m_actionKey, task.m_vars.OutputFile);
+        }
+    }
+
+    cache.save();
+}
+
+// updates the history and the action cache, reports the critical path, returns its length
+uint32_t finishBuild(BuildSet& build, TaskHistory& history, ActionCache* cache)
+{
+    updateHistory(history, build.m_tasks);
+
+    if (cache)
+    {
+        updateActionCache(*cache, build.m_tasks);
+    }
+
+    if (build.m_graph.empty())
+    {
+        return 0;
+    }
+
+    auto path = TaskGraph::realisedPath(build.m_tasks);
+
+    for (auto task : path)
+    {
+        LOGI("Critical path: task %u '%s' (%s), %u ms",
+             task->m_message.id(), task->m_name.c_str(), task->m_vars.SourceFile.c_str(), task->m_duration);
+    }
+
+    if (path.empty())
+    {
+        return 0;
+    }
+
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        path.back()->m_finishTime - path.front()->m_dispatchTime).count());
+}
+
+std::unique_ptr<ActionCache> loadActionCache(su::CommandLine& cl)
+{
+    if (cl.isSet(Arg::NOCACHE))
+    {
+        LOGN("The action cache is disabled");
+        return nullptr;
+    }
+
+    auto maxSize = static_cast<uint64_t>(std::max(atoll(cl.getOption(Arg::CACHESIZE).c_str()), 0ll)) << 20;
+    auto cache = std::make_unique<ActionCache>(cl.getOption(Arg::CACHE), maxSize);
+
+    cache->load();
+
+    return cache;
+}
+
+bool startServer(TcpProtobufServer& server, su::CommandLine& cl, const Projects& projects)
+{
+    server.setSpeculation(atof(cl.getOption(Arg::SPECULATE).c_str()));
+    server.setWeighted(atoi(cl.getOption(Arg::WEIGHTED).c_str()) != 0);
+    server.setRetry(atoi(cl.getOption(Arg::RETRY).c_str()), atoi(cl.getOption(Arg::QUARANTINE).c_str()));
+
+    int32_t localSlots = atoi(cl.getOption(Arg::LOCAL).c_str());
+    server.setLocalSlots(localSlots < 0 ? projects.getFreeCore() : static_cast<uint32_t>(localSlots));
+    server.run(16);
+
+    server.start();
+    if (!server.isStarted())
+    {
+        LOGE("Can not starting the Server. Error: %i", server.node()->getLastError());
+        return false;
+    }
+
+    LOGN("Server has been started");
+    return true;
+}
+
+// The persistent coordinator keeps the daemons connected between the builds and runs the build sets
+// submitted by the consoles of this host. The builds share the daemons by fair share
+int serve(su::CommandLine& cl, const Projects& projects, TaskHistory& history, const std::string& historyFile)
+{
+    auto actionCache = loadActionCache(cl);
+    TcpProtobufServer server(su::Net::TcpBroadcastAddress, Global::tcpDefaultPort, 0, &su::Log::instance());
+    server.setKeepAlive(true);
+    server.setActionCache(actionCache.get());
+
+    if (!startServer(server, cl, projects))
+    {
+        return 1;
+    }
+
+    CoordinatorServer coordinator(Global::tcpCoordinatorPort, &su::Log::instance());
+    coordinator.run(16);
+
+    coordinator.start();
+    if (!coordinator.isStarted())
+    {
+        LOGE("Can not starting the coordinator on port %u. Error: %i", Global::tcpCoordinatorPort, coordinator.node()->getLastError());
+        server.close();
+        return 1;
+    }
+
+    LOGN("The coordinator is listening on port %u", Global::tcpCoordinatorPort);
+    printf("coordinator is listening on port %u\n", Global::tcpCoordinatorPort);
+
+    std::unordered_map<uint32_t, std::unique_ptr<BuildSet>> builds;
+    std::unordered_map<uint32_t, std::unique_ptr<BuildSet>> released; // waiting for the server
+    std::vector<CompletionQueue::Item> completions;
+    std::atomic<uint32_t> ids = 0;
+    uint32_t lastBuild = 0;
+    std::chrono::steady_clock::time_point lastBroadcast;
+    std::chrono::steady_clock::time_point lastPing;
+
+    while (!Global::abort)
+    {
+        auto now = std::chrono::steady_clock::now();
+
+        // the new and the restarted daemons join by the broadcast, the connected ones ignore it
+        if (now - lastBroadcast >= broadcastPeriod)
+        {
+            for (const auto& prjName : projects.getNames())
+            {
+                sendBroadcast(prjName);
+            }
+            lastBroadcast = now;
+        }
+
+        for (auto& submission : coordinator.takeSubmissions())
+        {
+            auto build = std::make_unique<BuildSet>();
+            std::set<std::string> prjNames;
+            const auto& submit = submission.m_submit;
+
+            build->m_id = ++lastBuild;
+            build->m_client = submission.m_client;
+            build->m_config = submit.config();
+            build->m_vars.SDir = su::String_tolower(submit.sdir());
+            build->m_vars.ODir = su::String_tolower(submit.odir());
+            build->m_vars.WDir = su::String_tolower(submit.wdir());
+            build->m_vars.SFile = su::String_tolower(submit.sfile());
+            build->m_vars.OFile = su::String_tolower(submit.ofile());
+            build->m_history = history;
+            build->m_startTime = now;
+
+            if (!scanConfig(build->m_config, projects, prjNames, build->m_isGraph))
+            {
+                Coordinator::Packet packet;
+
+                packet.mutable_finished()->set_count(0);
+                packet.mutable_finished()->set_success(0);
+                packet.mutable_finished()->set_errors(0);
+                packet.mutable_finished()->set_failed(true);
+                coordinator.send(build->m_client, packet);
+                continue;
+            }
+
+            LOGN("Start the build %u '%s' of the console %s", build->m_id, build->m_config.c_str(), build->m_client.c_str());
+
+            startGenerator(*build, projects, server, ids);
+            builds[build->m_id] = std::move(build);
+        }
+
+        server.completions().wait(completions, renderPeriod);
+
+        // the results go to the consoles by batches
+        std::unordered_map<uint32_t, Coordinator::Packet> packets;
+
+        for (const auto& item : completions)
+        {
+            auto it = builds.find(item.m_build);
+            if (it == builds.end())
+            {
+                continue;
+            }
+
+            it->second->m_progress.add(item.m_doneIp, item.m_result, item.m_exitCode);
+
+            auto result = packets[item.m_build].add_results();
+            result->set_id(item.m_id);
+            result->set_doneip(item.m_doneIp);
+            result->set_process_code(static_cast<int32_t>(item.m_result));
+            result->set_exit_code(item.m_exitCode);
+        }
+
+        now = std::chrono::steady_clock::now();
+        bool isPing = now - lastPing >= pingPeriod;
+        lastPing = isPing ? now : lastPing;
+
+        for (auto it = builds.begin(); it != builds.end(); )
+        {
+            auto& build = *it->second;
+            auto& packet = packets[build.m_id];
+
+            packet.set_count(static_cast<uint32_t>(build.m_countTasks));
+            packet.set_ping(isPing);
+
+            if (!build.isFinished())
+            {
+                if (packet.results_size() || isPing)
+                {
+                    coordinator.send(build.m_client, packet);
+                }
+                ++it;
+                continue;
+            }
+
+            build.m_generator.join();
+            finishBuild(build, history, actionCache.get());
+            history.save(historyFile);
+
+            auto makespan = std::chrono::duration_cast<std::chrono::milliseconds>(now - build.m_startTime);
+            auto finished = packet.mutable_finished();
+
+            finished->set_count(static_cast<uint32_t>(build.m_countTasks));
+            finished->set_success(static_cast<uint32_t>(build.m_progress.m_countSuccess));
+            finished->set_errors(static_cast<uint32_t>(build.m_progress.m_countError));
+            finished->set_makespan(static_cast<uint32_t>(makespan.count()));
+            finished->set_failed(build.m_isFailed);
+            coordinator.send(build.m_client, packet);
+
+            LOGN("The build %u is finished: success %llu, errors %llu, %u ms", build.m_id,
+                 build.m_progress.m_countSuccess, build.m_progress.m_countError, finished->makespan());
+
+            if (actionCache)
+            {
+                LOGN("Action cache: %llu hits, %llu misses", actionCache->countHits(), actionCache->countMisses());
+            }
+
+            // the tasks are deleted when the server has forgotten them
+            server.release(build.m_id);
+            released[build.m_id] = std::move(it->second);
+            it = builds.erase(it);
+        }
+
+        for (auto id : server.takeReleased())
+        {
+            released.erase(id);
+        }
+    }
+
+    coordinator.close();
+    server.closeAllClients();
+
+    for (auto& [id, build] : builds)
+    {
+        build->m_generator.join();
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    server.close();
+
+    return 0;
+}
+
+// the thin console, the build set is run by the coordinator of this host
+int submitBuild(su::CommandLine& cl)
+{
+    Coordinator::Submit submit;
+    std::error_code ec;
+
+    // the coordinator has the other working directory
+    auto absolute = [&ec](const std::string& path)
+    {
+        return path.empty() ? path : su::String_tolower(fs::absolute(path, ec).string());
+    };
+
+    submit.set_config(absolute(cl.getOption(Arg::CONFIG)));
+    submit.set_sdir(absolute(cl.getOption(Arg::SDIR)));
+    submit.set_odir(absolute(cl.getOption(Arg::ODIR)));
+    submit.set_wdir(absolute(cl.getOption(Arg::WDIR)));
+    submit.set_sfile(absolute(cl.getOption(Arg::SFILE)));
+    submit.set_ofile(absolute(cl.getOption(Arg::OFILE)));
+
+    TcpProtobufNode node(Global::tcpMagicNumber, -1, &su::Log::instance());
+    CoordinatorClient client(node, submit, &su::Log::instance());
+
+    client.run(0);
+    client.connect("127.0.0.1", Global::tcpCoordinatorPort);
+
+    su::Terminal::setCursor(0, 0);
+    printf("--------------------+----------------------\n");
+
+    Progress progress;
+
+    while (!client.isFinished() && (client.isConnecting() || client.isConnected()))
+    {
+        for (const auto& result : client.takeResults())
+        {
+            progress.add(result.doneip(), static_cast<su::Process::ExitCodeResult>(result.process_code()), result.exit_code());
+        }
+
+        progress.render(client.countTasks(), false);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    for (const auto& result : client.takeResults())
+    {
+        progress.add(result.doneip(), static_cast<su::Process::ExitCodeResult>(result.process_code()), result.exit_code());
+    }
+
+    progress.render(client.countTasks(), true);
+    client.close();
+
+    if (!client.isFinished())
+    {
+        LOGE("Can not connect to the coordinator on port %u or the connection is lost", Global::tcpCoordinatorPort);
+        return 1;
+    }
+
+    auto finished = client.finished();
+
+    if (finished.failed())
+    {
+        LOGE("The coordinator can not load the build set '%s'", submit.config().c_str());
+        return 1;
+    }
+
+    printf("makespan: %.1f s\n", finished.makespan() / 1000.0);
+    LOGI("All processes have been completed. Success %u. Errors %u", finished.success(), finished.errors());
+    return 0;
+}
+
 int main(int argc, const char** argv)
 {
     su::CommandLine cl;
@@ -267,6 +970,17 @@ int main(int argc, const char** argv)
         .addOption(Arg::SFILE, "", "Output file. Value $(OFILE)")
         .addOption(Arg::LOG, "1", "Log level (0 only error ... 4 debug)")
         .addOption(Arg::WAIT, "3000", "Timer of waiting of daemons respond")
+        .addOption(Arg::HISTORY, ".\\fdbconsole.history", "File of the task duration history")
+        .addOption(Arg::SPECULATE, "0", "Duplicate the task at the end of build if it runs longer than N expected times (0 - disable)")
+        .addOption(Arg::RETRY, "0", "Count of retries of the failed task on other daemons")
+        .addOption(Arg::QUARANTINE, "0", "Count of faults in a row after which the daemon gets no tasks (0 - disable)")
+        .addOption(Arg::LOCAL, "0", "Count of tasks running on this host (-1 - free cores of the host, 0 - disable)")
+        .addOption(Arg::WEIGHTED, "0", "Scheduling by the daemon performance scores (0 - first come dispatch)")
+        .addOption(Arg::SERVE, "0", "Run as the persistent coordinator of the builds of this host")
+        .addOption(Arg::SUBMIT, "0", "Submit the build set to the coordinator of this host")
+        .addOption(Arg::CACHE, ".\\fdbconsole.cache", "Directory of the action cache, the outputs of the unchanged tasks")
+        .addOption(Arg::CACHESIZE, "4096", "Size of the action cache, MB")
+        .addSwitch(Arg::NOCACHE, "Run all tasks, the action cache is not used")
         .parse(argc, argv);
 
     su::Log::instance().setDir("./logs/");
@@ -281,59 +995,83 @@ int main(int argc, const char** argv)
 
     printf("\nfdbconsole v%u.%u\n", Global::versionMajor, Global::versionMinor);
 
+    bool isServe = atoi(cl.getOption(Arg::SERVE).c_str()) != 0;
+    bool isSubmit = atoi(cl.getOption(Arg::SUBMIT).c_str()) != 0;
     std::string configFile = cl.getOption(Arg::CONFIG);
-    if (configFile.empty())
+
+    if (configFile.empty() && !isServe)
     {
         printf("\nUsage: fdbconsole.exe --config=<xml file> [arguments]\n\n");
         cl.printArguments();
         return 0;
     }
 
+    WSADATA wsaData;
+    auto iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
+    if (iResult != NO_ERROR)
+    {
+        printf("Error at WSAStartup()\n");
+        return 1;
+    }
+
+    Global::abort = false;
+
+    if (isSubmit)
+    {
+        return submitBuild(cl);
+    }
+
     Projects projects(&su::Log::instance());
-    TaskVariables taskVarible;
-    std::vector<TaskInfo> tasks;
 
     if (!projects.loadFromFile(su::String_filenamePath(cl.getApplication()) + "\\" + Global::fileProjects))
     {
         return 1;
     }
 
-    taskVarible.SDir = su::String_tolower(cl.getOption(Arg::SDIR));
-    taskVarible.ODir = su::String_tolower(cl.getOption(Arg::ODIR));
-    taskVarible.WDir = su::String_tolower(cl.getOption(Arg::WDIR));
-    taskVarible.SFile = su::String_tolower(cl.getOption(Arg::SFILE));
-    taskVarible.OFile = su::String_tolower(cl.getOption(Arg::OFILE));
-    
-    if (!loadConfig(configFile, projects, taskVarible, tasks))
+    TaskHistory history;
+    std::string historyFile = cl.getOption(Arg::HISTORY);
+
+    history.load(historyFile);
+
+    if (isServe)
     {
-        return 1;
+        return serve(cl, projects, history, historyFile);
     }
 
-    WSADATA wsaData;
-    auto iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
-    if (iResult != NO_ERROR)
+    BuildSet build;
+    std::set<std::string> prjNames;
+
+    build.m_config = configFile;
+    build.m_vars.SDir = su::String_tolower(cl.getOption(Arg::SDIR));
+    build.m_vars.ODir = su::String_tolower(cl.getOption(Arg::ODIR));
+    build.m_vars.WDir = su::String_tolower(cl.getOption(Arg::WDIR));
+    build.m_vars.SFile = su::String_tolower(cl.getOption(Arg::SFILE));
+    build.m_vars.OFile = su::String_tolower(cl.getOption(Arg::OFILE));
+    build.m_history = history;
+
+    if (!scanConfig(configFile, projects, prjNames, build.m_isGraph))
     {
-        printf("Error at WSAStartup()\n");
         return 1;
     }
 
-    Global::abort = false;
-
-    TcpProtobufServer server(tasks, su::Net::TcpBroadcastAddress, Global::tcpDefaultPort, 0, &su::Log::instance());
-    server.run(16);
+    auto actionCache = loadActionCache(cl);
+    TcpProtobufServer server(su::Net::TcpBroadcastAddress, Global::tcpDefaultPort, 0, &su::Log::instance());
 
-    server.start();
-    if (server.isStarted())
+    server.setActionCache(actionCache.get());
+    if (!startServer(server, cl, projects))
     {
-        LOGN("Server has been started");
+        return 1;
     }
-    else
+
+    // the daemon joins if it knows any project of the build set
+    bool isBroadcastSent = true;
+
+    for (const auto& prjName : prjNames)
     {
-        LOGE("Can not starting the Server. Error: %i", server.node()->getLastError());
-        return 1;
+        isBroadcastSent = sendBroadcast(prjName) && isBroadcastSent;
     }
 
-    if (!sendBroadcast(tasks[0].m_vars.PName))
+    if (!isBroadcastSent)
     {
         server.finish();
         while (server.status() != su::ThreadClass::Status::Finished)
@@ -345,6 +1083,10 @@ int main(int argc, const char** argv)
         return 1;
     }
 
+    // the tasks are generated while the daemons are connecting and the first tasks are running
+    std::atomic<uint32_t> ids = 0;
+    startGenerator(build, projects, server, ids);
+
     size_t timeWaiting = atoi(cl.getOption(Arg::WAIT).c_str());
     su::TickCount workTimer;
 
@@ -357,22 +1099,17 @@ int main(int argc, const char** argv)
 #endif
     }
 
-    struct ItemSlaveInfo
-    {
-        size_t m_success = 0;
-        size_t m_errors = 0;
-    };
-
     su::Terminal::setCursor(0, 0);
     printf("--------------------+----------------------\n");
 
-    std::unordered_map<std::string, ItemSlaveInfo> info;
-    size_t countError = 0;
-    size_t countSuccess = 0;
-    bool isFinished = false;
-    while (!isFinished)
+    std::vector<CompletionQueue::Item> completions;
+    auto& progress = build.m_progress;
+
+    // the server pushes the final results, the failed tasks are retried by the server before
+    while (!build.isFinished())
     {
-        if (server.clientsCount())
+        // the local slots do not wait for daemons
+        if (server.clientsCount() || server.hasLocalSlots())
         {
             workTimer.restart();
         }
@@ -382,76 +1119,61 @@ int main(int argc, const char** argv)
             break;
         }
 
-        isFinished = true;
+        server.completions().wait(completions, renderPeriod);
 
-        //TODO Если демон вернул ошибку, то эту таску нужно отдать другому??? или пометить как аварийную и продолжить?
-        //     или же смотреть переменную AbortOnError, и если она =1, то вообще выходить? Тогда может быть ее вынести
-        //     в настройки проекта?
-        for (TaskInfo& task : tasks)
+        for (const auto& item : completions)
         {
-            std::lock_guard<std::mutex> guard(task.m_mutex);
-
-            if (task.m_result == su::Process::ExitCodeResult::NoInit)
-            {
-                isFinished = false;
-                continue;
-            }
+            progress.add(item.m_doneIp, item.m_result, item.m_exitCode);
+        }
 
-            if (task.m_doneIp.empty())
-            {
-                continue;
-            }
+        progress.render(build.m_countTasks, progress.m_countDone == build.m_countTasks);
+    }
 
-            if (task.m_result == su::Process::ExitCodeResult::NotStarted)
-            {
-                ++info[task.m_doneIp].m_errors;
-            }
+    server.closeAllClients();
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
 
-            if (task.m_result == su::Process::ExitCodeResult::Exited)
-            {
-                if (task.m_exitCode)
-                {
-                    ++info[task.m_doneIp].m_errors;
-                }
-                else
-                {
-                    ++info[task.m_doneIp].m_success;
-                }
-            }
-            task.m_doneIp = "";
-        }
+    server.close();
+    build.m_generator.join();
 
-        countError = 0;
-        countSuccess = 0;
-        su::Terminal::setCursor(0, 1);
+    if (build.m_isFailed)
+    {
+        return 1;
+    }
 
-        for (const auto& [ip, value]: info)
-        {
-            countError += value.m_errors;
-            countSuccess += value.m_success;
+    for (const auto& host : server.quarantinedHosts())
+    {
+        LOGW("The host %s was quarantined", host.c_str());
+        printf("quarantined host %s\n", host.c_str());
+    }
 
-            printf("%19s | %llu/%llu/%llu          \n",
-                   ip.c_str(), value.m_errors, value.m_success, value.m_errors + value.m_success);
-        }
-        printf("total               | %llu/%llu/%llu %3.1f%%\n",
-               countError, countSuccess, tasks.size(),
-               double(countError + countSuccess) / tasks.size() * 100.0);
+    uint32_t critical = finishBuild(build, history, actionCache.get());
+    history.save(historyFile);
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    if (critical)
+    {
+        printf("critical path: %.1f s\n", critical / 1000.0);
     }
 
-    server.closeAllClients();
-    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    LOGI("Input cache: %llu uploads skipped, %llu bytes saved", server.countUploadsSkipped(), server.bytesUploadsSkipped());
+    LOGI("Output writer: %llu outputs not changed", server.countOutputsUnchanged());
 
-    server.close();
+    if (actionCache)
+    {
+        LOGI("Action cache: %llu hits, %llu misses", actionCache->countHits(), actionCache->countMisses());
+        printf("action cache: %llu hits, %llu misses\n", actionCache->countHits(), actionCache->countMisses());
+    }
+
+    uint32_t predicted = predictMakespan(build.m_tasks, server.peakInFlight());
+    LOGI("Makespan: predicted %u ms on %llu slots, actual %u ms", predicted, server.peakInFlight(), server.makespan());
+    printf("makespan: predicted %.1f s, actual %.1f s\n", predicted / 1000.0, server.makespan() / 1000.0);
 
     if (workTimer.isFinished())
     {
-        LOGW("No one daemon else responding! Tasks: %llu success, %llu fault", countSuccess, countError);
+        LOGW("No one daemon else responding! Tasks: %llu success, %llu fault", progress.m_countSuccess, progress.m_countError);
         return 1;
     }
 
-    LOGI("All processes have been completed. Success %llu. Errors %llu", countSuccess, countError);
+    LOGI("All processes have been completed. Success %llu. Errors %llu", progress.m_countSuccess, progress.m_countError);
     return 0;
 
 }
@@ -3,8 +3,11 @@
 
 #define WIN32_LEAN_AND_MEAN
 
+#include <atomic>
+#include <chrono>
 #include <string>
-#include <mutex>
+#include <unordered_set>
+#include <vector>
 
 #include "stringex.h"
 #include "win/process.h"
@@ -52,6 +55,18 @@ struct TaskVariables
 
 };
 
+// Pending -> Dispatched [-> Running] -> Done | Failed. The dispatched or running task may go back to Pending,
+// if it is retried or its node is lost. Running is known only for the local tasks, the daemons do not report it.
+// The pending task fails without dispatch if its dependency failed, it is done without dispatch if its output is cached
+enum class TaskState : uint8_t
+{
+    Pending,
+    Dispatched,
+    Running,
+    Done,
+    Failed,
+};
+
 struct TaskInfo
 {
     TaskInfo(uint32_t id)
@@ -71,7 +86,14 @@ struct TaskInfo
     {
         m_vars = mti.m_vars;
         m_message = mti.m_message;
-        //?????m_node = mti.m_node;
+        m_priority = mti.m_priority;
+        m_expected = mti.m_expected;
+        m_inputSize = mti.m_inputSize;
+        m_affinity = mti.m_affinity;
+        m_affinityHash = mti.m_affinityHash;
+        m_name = mti.m_name;
+        m_dependsOn = mti.m_dependsOn;
+        m_inputs = mti.m_inputs;
     }
 
     TaskInfo& operator = (const TaskInfo& ti)
@@ -80,12 +102,77 @@ struct TaskInfo
         return *this;
     }
 
+    // the result fields are written before the final state, so the final state publishes them
+    bool moveTo(TaskState to)
+    {
+        TaskState from = m_state.load();
+
+        do
+        {
+            if (!isAllowed(from, to))
+            {
+                return false;
+            }
+        }
+        while (!m_state.compare_exchange_weak(from, to));
+
+        return true;
+    }
+
+    bool isFinished() const
+    {
+        TaskState state = m_state.load();
+
+        return state == TaskState::Done || state == TaskState::Failed;
+    }
+
+    static bool isAllowed(TaskState from, TaskState to)
+    {
+        switch (from)
+        {
+            case TaskState::Pending: return to != TaskState::Pending && to != TaskState::Running;
+            case TaskState::Dispatched: return to != TaskState::Dispatched;
+            case TaskState::Running: return to != TaskState::Dispatched && to != TaskState::Running;
+            default: return false;
+        }
+    }
+
     TaskVariables m_vars;
 
     Master::Task m_message;
-    std::mutex m_mutex;
-    TcpProtobufNode* m_node = nullptr;
+
+    // scheduling, the larger priority goes first
+    uint64_t m_priority = 0;
+    uint32_t m_expected = 0; // predicted wall time, ms
+    uint64_t m_inputSize = 0;
+    std::vector<std::string> m_inputs; // the other input files, the manifest is made of them
+    bool m_isRead = false; // the input is requested from the read-ahead
+
+    // the host of the previous build and the hash of its input, hex
+    std::string m_affinity = "";
+    std::string m_affinityHash = "";
+
+    // dependency graph, the tokens are the id, the name or the output file of other tasks
+    std::string m_name = "";
+    std::vector<std::string> m_dependsOn;
+    std::vector<TaskInfo*> m_dependencies;
+    std::vector<TaskInfo*> m_dependents;
+    size_t m_waiting = 0; // unfinished dependencies, the task is queued when it is zero
+
+    std::atomic<TaskState> m_state = TaskState::Pending;
+    uint32_t m_build = 0; // the build set of the coordinator
+    uint32_t m_copies = 0; // dispatched copies, more than one for the speculative execution
+    uint32_t m_attempts = 0;
+    std::unordered_set<std::string> m_failedHosts;
     int32_t m_exitCode = 0;
     su::Process::ExitCodeResult m_result = su::Process::ExitCodeResult::NoInit;
     std::string m_doneIp = "";
+    std::chrono::steady_clock::time_point m_dispatchTime;
+    uint32_t m_duration = 0; // real wall time, ms
+    std::chrono::steady_clock::time_point m_finishTime;
+    std::string m_doneHost = "";
+    std::string m_inputHash = ""; // sha256 of the sent input
+    std::string m_toolHash = "";  // sha256 of the application, it is read with the input
+    std::string m_actionKey = ""; // the key of the action cache, hex
+    bool m_isCached = false;      // the output is restored from the action cache
 };
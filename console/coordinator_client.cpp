@@ -0,0 +1,72 @@
+
+#include "coordinator_client.h"
+
+CoordinatorClient::CoordinatorClient(TcpProtobufNode& node, const Coordinator::Submit& submit, su::Log* plog) :
+    su::Net::TcpClient(node, plog),
+    m_submit(submit)
+{
+}
+
+std::vector<Coordinator::Result> CoordinatorClient::takeResults()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    return std::move(m_results);
+}
+
+Coordinator::Finished CoordinatorClient::finished()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    return m_finished;
+}
+
+bool CoordinatorClient::onConnect()
+{
+    Coordinator::Packet packet;
+
+    packet.mutable_submit()->CopyFrom(m_submit);
+
+    LOGSPN(getLog(), "Submit the build set '%s' to the coordinator", m_submit.config().c_str());
+
+    return static_cast<TcpProtobufNode*>(getNode())->send(packet);
+}
+
+bool CoordinatorClient::onRecvFromNode()
+{
+    auto protoNode = static_cast<TcpProtobufNode*>(getNode());
+
+    while (protoNode->countRecvPackets())
+    {
+        auto data = protoNode->extractRecvPacket();
+
+        Coordinator::Packet packet;
+
+        packet.ParseFromArray(data.raw.data(), (int)data.raw.size());
+
+        if (!packet.IsInitialized())
+        {
+            LOGSPE(getLog(), "Can not parse the coordinator protobuf packet");
+            return false;
+        }
+
+        TcpClient::restartKeepAliveTimer();
+
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        if (packet.has_count())
+        {
+            m_countTasks = packet.count();
+        }
+
+        m_results.insert(m_results.end(), packet.results().begin(), packet.results().end());
+
+        if (packet.has_finished())
+        {
+            m_finished.CopyFrom(packet.finished());
+            m_isFinished = true;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,42 @@
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "net/tcp_client.h"
+#include "tcp_protobufnode.h"
+
+#pragma warning(disable:4251)
+#include "coordinator.pb.h"
+#pragma warning(default:4251)
+
+// The thin console, it submits the build set to the coordinator on the same host and receives the results
+class CoordinatorClient : public su::Net::TcpClient
+{
+public:
+    CoordinatorClient(TcpProtobufNode& node, const Coordinator::Submit& submit, su::Log* plog = nullptr);
+    virtual ~CoordinatorClient() = default;
+
+    // the results received since the last call
+    std::vector<Coordinator::Result> takeResults();
+    size_t countTasks() const { return m_countTasks; }
+
+    bool isFinished() const { return m_isFinished; }
+    Coordinator::Finished finished();
+
+protected:
+    // su::TcpClient
+    virtual bool onConnect() override;
+    virtual bool onRecvFromNode() override;
+
+private:
+    Coordinator::Submit m_submit;
+
+    std::mutex m_mutex;
+    std::vector<Coordinator::Result> m_results;
+    Coordinator::Finished m_finished;
+    std::atomic<size_t> m_countTasks = 0;
+    std::atomic_bool m_isFinished = false;
+};
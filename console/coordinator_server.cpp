@@ -0,0 +1,68 @@
+
+#include "coordinator_server.h"
+
+#include "global_constants.h"
+#include "tcp_protobufnode.h"
+
+CoordinatorServer::CoordinatorServer(uint16_t port, su::Log* plog) :
+    su::Net::TcpServer("127.0.0.1", port, 0, plog)
+{
+}
+
+std::vector<CoordinatorServer::Submission> CoordinatorServer::takeSubmissions()
+{
+    std::lock_guard<std::mutex> guard(m_submitMutex);
+
+    return std::move(m_submissions);
+}
+
+bool CoordinatorServer::send(const std::string& client, const Coordinator::Packet& packet)
+{
+    std::lock_guard<std::mutex> guard(getMutex());
+
+    for (auto node : m_clients)
+    {
+        if (node->fullId() == client)
+        {
+            return static_cast<TcpProtobufNode*>(node)->send(packet);
+        }
+    }
+
+    return false;
+}
+
+bool CoordinatorServer::onRecvFromNode(su::Net::Node* node)
+{
+    auto protoNode = static_cast<TcpProtobufNode*>(node);
+
+    while (protoNode->countRecvPackets())
+    {
+        auto data = protoNode->extractRecvPacket();
+
+        Coordinator::Packet packet;
+
+        packet.ParseFromArray(data.raw.data(), (int)data.raw.size());
+
+        if (!packet.IsInitialized())
+        {
+            LOGSPE(getLog(), "Can not parse the console protobuf packet");
+            return false;
+        }
+
+        if (packet.has_submit())
+        {
+            LOGSPN(getLog(), "The console %s submitted the build set '%s'",
+                   node->fullId().c_str(), packet.submit().config().c_str());
+
+            std::lock_guard<std::mutex> guard(m_submitMutex);
+            m_submissions.push_back({node->fullId(), packet.submit()});
+        }
+    }
+
+    return true;
+}
+
+su::Net::Node* CoordinatorServer::newClient(SOCKET socket, const sockaddr_in& addr)
+{
+    return new TcpProtobufNode(Global::tcpMagicNumber, socket, addr, getNextClientId(), getLog());
+}
@@ -0,0 +1,40 @@
+
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "net/tcp_server.h"
+
+#pragma warning(disable:4251)
+#include "coordinator.pb.h"
+#pragma warning(default:4251)
+
+// The local socket of the persistent coordinator. The consoles submit the build sets here and receive the results.
+// The client is identified by its full id, so the result of the disconnected client is dropped
+class CoordinatorServer : public su::Net::TcpServer
+{
+public:
+    struct Submission
+    {
+        std::string m_client = "";
+        Coordinator::Submit m_submit;
+    };
+
+public:
+    CoordinatorServer(uint16_t port, su::Log* plog);
+    virtual ~CoordinatorServer() = default;
+
+    std::vector<Submission> takeSubmissions();
+    bool send(const std::string& client, const Coordinator::Packet& packet);
+
+protected:
+    // TcpServer
+    virtual bool onRecvFromNode(su::Net::Node* node) override;
+    virtual su::Net::Node* newClient(SOCKET socket, const sockaddr_in& addr) override;
+
+private:
+    std::mutex m_submitMutex;
+    std::vector<Submission> m_submissions;
+};
@@ -0,0 +1,181 @@
+
+#include "local_worker.h"
+
+#include <filesystem>
+
+#include "stringex.h"
+
+#include "console.h"
+#include "global_constants.h"
+
+namespace fs = std::filesystem;
+
+LocalWorker::LocalWorker(uint32_t slots, su::Log* plog) :
+    m_log(plog),
+    m_slots(slots),
+    m_node(Global::tcpMagicNumber, -1, plog)
+{
+    // the local task uses the files in place, so it supports all features of the protocol
+    m_node.m_host = "localhost";
+    m_node.m_protocol = Global::protocolVersion;
+    m_node.m_score = 0.0f; // it does not count in the best score until the calibration
+
+    // the calibration takes a while, the console does not wait for it
+    m_calibration = std::thread([this]()
+    {
+        m_performance.calibrate();
+        m_isCalibrated = true;
+    });
+}
+
+LocalWorker::~LocalWorker()
+{
+    m_calibration.join();
+
+    for (auto& task : m_tasks)
+    {
+        task->m_process->terminate();
+        removeOutput(task->m_outputFile);
+    }
+}
+
+bool LocalWorker::takeCalibration()
+{
+    if (m_isScored || !m_isCalibrated)
+    {
+        return false;
+    }
+
+    m_node.m_score = m_performance.getScore();
+    m_node.m_cores = m_performance.getCores();
+    m_node.m_memory = m_performance.getMemory();
+    m_isScored = true;
+
+    LOGSPN(m_log, "Local slots %u, score %.2f", m_slots, m_node.m_score);
+
+    return true;
+}
+
+uint32_t LocalWorker::countFreeSlots() const
+{
+    // the weighted dispatch needs the score of the slots
+    if (!m_isScored)
+    {
+        return 0;
+    }
+
+    return m_tasks.size() < m_slots ? m_slots - static_cast<uint32_t>(m_tasks.size()) : 0;
+}
+
+bool LocalWorker::isRedirected(const TaskInfo& task)
+{
+    const auto& message = task.m_message;
+
+    return message.outputfile().size() && message.commandline().find(message.outputfile()) != std::string::npos;
+}
+
+bool LocalWorker::start(TaskInfo* info)
+{
+    const auto& message = info->m_message;
+    const auto& pdir = info->m_vars.PDir;
+
+    // the tool writes the temporary output, so the speculative copy on a daemon does not race with it.
+    // The tool finds the output by the command line only, as it does on the daemon
+    if (!isRedirected(*info))
+    {
+        LOGSPW(m_log, "The output of task %u is not in its command line, it does not run locally", message.id());
+        return false;
+    }
+
+    auto task = std::make_unique<Task>();
+    std::string commandline = message.commandline();
+    fs::path output = info->m_vars.OutputFile;
+
+    task->m_outputFile = (output.parent_path() / (output.stem().string() + ".local" + output.extension().string())).string();
+    commandline = su::String_replace(commandline, message.outputfile(),
+                                     su::String_replace(task->m_outputFile, pdir, "$(pdir)", true), true);
+
+    // all the project related paths are the real ones, the files are not copied to the work directory
+    std::string application = su::String_replace(message.application(), "$(pdir)", pdir, true);
+    std::string workingdir = su::String_replace(message.workingdir(), "$(pdir)", pdir, true);
+
+    commandline = su::String_replace(commandline, "$(pdir)", pdir, true);
+
+    std::error_code ec;
+    fs::create_directories(fs::path(info->m_vars.OutputFile).parent_path(), ec);
+
+    LOGSPI(m_log, "Run local task %u: wdir='%s' app='%s' params='%s'",
+           message.id(), workingdir.c_str(), application.c_str(), commandline.c_str());
+
+    task->m_task = info;
+    task->m_process = std::make_unique<su::Process::AppObject>(application.c_str(),
+                                                               commandline.c_str(),
+                                                               workingdir.c_str(),
+                                                               su::Process::LaunchMode::NoConsole);
+    task->m_process->execute();
+    task->m_startTime = std::chrono::steady_clock::now();
+
+    m_tasks.push_back(std::move(task));
+
+    return true;
+}
+
+void LocalWorker::cancel(uint32_t id)
+{
+    for (auto it = m_tasks.begin(); it != m_tasks.end(); ++it)
+    {
+        if ((*it)->m_task->m_message.id() == id)
+        {
+            (*it)->m_process->terminate();
+            removeOutput((*it)->m_outputFile);
+            m_tasks.erase(it);
+
+            LOGSPI(m_log, "The local task %u is cancelled", id);
+            return;
+        }
+    }
+}
+
+void LocalWorker::removeOutput(const std::string& filename)
+{
+    std::error_code ec;
+
+    if (filename.size())
+    {
+        fs::remove(filename, ec);
+    }
+}
+
+std::vector<Slave::Result> LocalWorker::collect()
+{
+    std::vector<Slave::Result> out;
+
+    for (size_t ii = 0; ii < m_tasks.size(); ++ii)
+    {
+        auto& task = m_tasks[ii];
+
+        if (task->m_process->isRunning())
+        {
+            continue;
+        }
+
+        Slave::Result result;
+        int exitCode = 0;
+        auto resultCode = task->m_process->getProcessExitCode(&exitCode);
+
+        result.set_id(task->m_task->m_message.id());
+        result.set_exit_code(exitCode);
+        result.set_process_code(static_cast<int32_t>(resultCode));
+        result.set_duration(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - task->m_startTime).count()));
+
+        result.set_outputfile(task->m_outputFile);
+
+        out.push_back(std::move(result));
+
+        m_tasks.erase(m_tasks.begin() + ii);
+        --ii;
+    }
+
+    return out;
+}
@@ -0,0 +1,65 @@
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "win/process.h"
+
+#include "host_performance.h"
+#include "tcp_protobufnode.h"
+
+#pragma warning(disable:4251)
+#include "slave.pb.h"
+#pragma warning(default:4251)
+
+struct TaskInfo;
+
+// Runs the tasks on the console host. The source files are used in place, without the temp copies
+// and the network. The output file goes to the temporary file next to it, the server renames it,
+// if the local copy wins. The task, whose output can not be redirected, is left to the daemons.
+// It is polled from the server thread, so it does not have own thread. The host is calibrated on the
+// separate thread, the slots get no tasks until the score is known.
+class LocalWorker
+{
+    struct Task
+    {
+        TaskInfo* m_task = nullptr;
+        std::unique_ptr<su::Process::AppObject> m_process;
+        std::chrono::steady_clock::time_point m_startTime;
+        std::string m_outputFile = ""; // the temporary output
+    };
+
+public:
+    LocalWorker(uint32_t slots, su::Log* plog = nullptr);
+    virtual ~LocalWorker();
+
+    // the identity of the local slots in the task queue, it is never connected
+    TcpProtobufNode* node() { return &m_node; }
+
+    uint32_t countFreeSlots() const;
+    // true once, when the score of the node is set by the finished calibration
+    bool takeCalibration();
+
+    // the output goes to the temporary file by the command line, the other task does not run locally
+    static bool isRedirected(const TaskInfo& task);
+    // false, if the task does not run locally
+    bool start(TaskInfo* task);
+    // the output of the failed or the losing task
+    static void removeOutput(const std::string& filename);
+    void cancel(uint32_t id);
+    std::vector<Slave::Result> collect();
+
+private:
+    su::Log* m_log = nullptr;
+    uint32_t m_slots = 0;
+    TcpProtobufNode m_node;
+    std::vector<std::unique_ptr<Task>> m_tasks;
+    HostPerformance m_performance;
+    std::atomic<bool> m_isCalibrated = false;
+    bool m_isScored = false;
+    std::thread m_calibration;
+};
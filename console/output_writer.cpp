@@ -0,0 +1,389 @@
+
+#include "output_writer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <io.h>
+
+#include "sha256.h"
+
+namespace fs = std::filesystem;
+
+OutputWriter::OutputWriter(size_t threads)
+{
+    for (size_t ii = 0; ii < std::max<size_t>(threads, 1); ++ii)
+    {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+
+    for (auto& worker : m_workers)
+    {
+        worker->m_thread = std::thread(&OutputWriter::work, this, std::ref(*worker));
+    }
+}
+
+OutputWriter::~OutputWriter()
+{
+    for (auto& worker : m_workers)
+    {
+        {
+            std::lock_guard<std::mutex> guard(worker->m_mutex);
+            worker->m_isStopped = true;
+        }
+
+        worker->m_event.notify_all();
+        worker->m_thread.join();
+    }
+}
+
+uint64_t OutputWriter::open(const std::string& filename)
+{
+    Job job;
+
+    job.m_type = Job::Open;
+    job.m_key = ++m_countKeys;
+    job.m_filename = filename;
+    push(std::move(job));
+
+    return m_countKeys;
+}
+
+void OutputWriter::write(uint64_t key, uint64_t offset, std::string&& data)
+{
+    Job job;
+
+    job.m_type = Job::Write;
+    job.m_key = key;
+    job.m_offset = offset;
+    job.m_data = std::move(data);
+    push(std::move(job));
+}
+
+void OutputWriter::finish(uint64_t key, const std::string& digest)
+{
+    Job job;
+
+    job.m_type = Job::Finish;
+    job.m_key = key;
+    job.m_data = digest;
+    push(std::move(job));
+}
+
+void OutputWriter::commit(uint64_t key, uint32_t id)
+{
+    Job job;
+
+    job.m_type = Job::Commit;
+    job.m_key = key;
+    job.m_id = id;
+    push(std::move(job));
+}
+
+void OutputWriter::drop(uint64_t key)
+{
+    Job job;
+
+    job.m_type = Job::Drop;
+    job.m_key = key;
+    push(std::move(job));
+}
+
+void OutputWriter::save(uint32_t id, const std::string& filename, std::string&& data)
+{
+    Job job;
+
+    job.m_type = Job::Save;
+    job.m_key = ++m_countKeys;
+    job.m_id = id;
+    job.m_filename = filename;
+    job.m_data = std::move(data);
+    push(std::move(job));
+}
+
+void OutputWriter::move(uint32_t id, const std::string& from, const std::string& filename)
+{
+    Job job;
+
+    job.m_type = Job::Move;
+    job.m_key = ++m_countKeys;
+    job.m_id = id;
+    job.m_filename = filename;
+    job.m_data = from;
+    push(std::move(job));
+}
+
+void OutputWriter::copy(uint32_t id, const std::string& from, const std::string& filename)
+{
+    Job job;
+
+    job.m_type = Job::Copy;
+    job.m_key = ++m_countKeys;
+    job.m_id = id;
+    job.m_filename = filename;
+    job.m_data = from;
+    push(std::move(job));
+}
+
+std::vector<OutputWriter::Result> OutputWriter::takeReady()
+{
+    std::lock_guard<std::mutex> guard(m_readyMutex);
+
+    return std::move(m_ready);
+}
+
+void OutputWriter::push(Job&& job)
+{
+    auto& worker = *m_workers[job.m_key % m_workers.size()];
+
+    {
+        std::lock_guard<std::mutex> guard(worker.m_mutex);
+        worker.m_jobs.push_back(std::move(job));
+    }
+
+    worker.m_event.notify_one();
+}
+
+void OutputWriter::ready(uint32_t id, const std::string& filename, bool isSaved, bool isUnchanged)
+{
+    std::lock_guard<std::mutex> guard(m_readyMutex);
+
+    m_ready.push_back({id, filename, isSaved, isUnchanged});
+}
+
+bool OutputWriter::hashFile(const std::string& filename, std::string& digest)
+{
+    std::ifstream file(filename, std::ios::binary);
+    std::string buffer(FileTransfer::chunkSize, '\0');
+    Sha256 sha;
+
+    while (file)
+    {
+        file.read(buffer.data(), buffer.size());
+        sha.update(buffer.data(), static_cast<size_t>(file.gcount()));
+    }
+
+    digest = sha.final();
+
+    return file.eof() && !file.bad();
+}
+
+bool OutputWriter::isSame(const std::string& filename, uint64_t size, const std::string& digest)
+{
+    std::error_code ec;
+    std::string current;
+
+    if (fs::file_size(filename, ec) != size || ec)
+    {
+        return false;
+    }
+
+    return hashFile(filename, current) && current == digest;
+}
+
+bool OutputWriter::syncFile(const std::string& filename)
+{
+    std::FILE* file = std::fopen(filename.c_str(), "r+b");
+
+    if (!file)
+    {
+        return false;
+    }
+
+    bool result = !_commit(_fileno(file));
+
+    std::fclose(file);
+
+    return result;
+}
+
+void OutputWriter::work(Worker& worker)
+{
+    while (true)
+    {
+        std::deque<Job> jobs;
+
+        {
+            std::unique_lock<std::mutex> lock(worker.m_mutex);
+
+            worker.m_event.wait(lock, [&worker] { return worker.m_isStopped || worker.m_jobs.size(); });
+            if (worker.m_isStopped)
+            {
+                return;
+            }
+
+            jobs.swap(worker.m_jobs);
+        }
+
+        // the whole batch is synced before the files are renamed
+        std::vector<std::pair<uint32_t, std::unique_ptr<ChunkWriter>>> commits;
+
+        for (auto& job : jobs)
+        {
+            apply(worker, job, commits);
+        }
+
+        std::vector<bool> isSynced;
+
+        for (auto& commit : commits)
+        {
+            isSynced.push_back(commit.second->sync());
+        }
+
+        for (size_t ii = 0; ii < commits.size(); ++ii)
+        {
+            auto& writer = commits[ii].second;
+
+            ready(commits[ii].first, writer->filename(), isSynced[ii] && writer->commit(), false);
+        }
+    }
+}
+
+void OutputWriter::apply(Worker& worker, Job& job, std::vector<std::pair<uint32_t, std::unique_ptr<ChunkWriter>>>& commits)
+{
+    switch (job.m_type)
+    {
+        case Job::Open:
+        {
+            worker.m_files[job.m_key] = std::make_unique<ChunkWriter>(job.m_filename, ".part" + std::to_string(job.m_key));
+            return;
+        }
+
+        case Job::Write:
+        {
+            if (auto it = worker.m_files.find(job.m_key); it != worker.m_files.end())
+            {
+                it->second->write(job.m_offset, job.m_data);
+            }
+            return;
+        }
+
+        case Job::Finish:
+        {
+            if (auto it = worker.m_files.find(job.m_key); it != worker.m_files.end())
+            {
+                it->second->finish(job.m_data);
+            }
+            return;
+        }
+
+        case Job::Drop:
+        {
+            worker.m_files.erase(job.m_key);
+            return;
+        }
+
+        case Job::Commit:
+        {
+            auto it = worker.m_files.find(job.m_key);
+            std::unique_ptr<ChunkWriter> writer;
+
+            if (it != worker.m_files.end())
+            {
+                writer = std::move(it->second);
+                worker.m_files.erase(it);
+            }
+
+            // the output is not received whole or it is corrupted
+            if (!writer || !writer->isFinished())
+            {
+                ready(job.m_id, writer ? writer->filename() : "", false, false);
+                return;
+            }
+
+            if (isSame(writer->filename(), writer->size(), writer->digest()))
+            {
+                ready(job.m_id, writer->filename(), true, true);
+                return;
+            }
+
+            commits.emplace_back(job.m_id, std::move(writer));
+            return;
+        }
+
+        case Job::Save:
+        {
+            if (isSame(job.m_filename, job.m_data.size(), Sha256::get(job.m_data)))
+            {
+                ready(job.m_id, job.m_filename, true, true);
+                return;
+            }
+
+            auto writer = std::make_unique<ChunkWriter>(job.m_filename, ".part" + std::to_string(job.m_key));
+
+            writer->write(0, job.m_data);
+            writer->finish();
+            commits.emplace_back(job.m_id, std::move(writer));
+            return;
+        }
+
+        case Job::Move:
+        {
+            // the file is not in the batch, it is not written by the writer
+            std::error_code ec;
+            std::string digest;
+            auto size = fs::file_size(job.m_data, ec);
+            bool isRead = !ec && hashFile(job.m_data, digest);
+
+            if (isRead && isSame(job.m_filename, size, digest))
+            {
+                fs::remove(job.m_data, ec);
+                ready(job.m_id, job.m_filename, true, true);
+                return;
+            }
+
+            bool isSaved = isRead && syncFile(job.m_data);
+
+            if (isSaved)
+            {
+                fs::rename(job.m_data, job.m_filename, ec);
+                isSaved = !ec;
+            }
+
+            if (!isSaved)
+            {
+                fs::remove(job.m_data, ec);
+            }
+
+            ready(job.m_id, job.m_filename, isSaved, false);
+            return;
+        }
+
+        case Job::Copy:
+        {
+            std::error_code ec;
+            std::string digest;
+            auto size = fs::file_size(job.m_data, ec);
+            bool isRead = !ec && hashFile(job.m_data, digest);
+
+            if (isRead && isSame(job.m_filename, size, digest))
+            {
+                ready(job.m_id, job.m_filename, true, true);
+                return;
+            }
+
+            // the copy is renamed as the other outputs, the reader of the output does not see it half written
+            std::string temp = job.m_filename + ".part" + std::to_string(job.m_key);
+
+            fs::create_directories(fs::path(job.m_filename).parent_path(), ec);
+
+            bool isSaved = isRead && fs::copy_file(job.m_data, temp, fs::copy_options::overwrite_existing, ec) && !ec &&
+                           syncFile(temp);
+
+            if (isSaved)
+            {
+                fs::rename(temp, job.m_filename, ec);
+                isSaved = !ec;
+            }
+
+            if (!isSaved)
+            {
+                fs::remove(temp, ec);
+            }
+
+            ready(job.m_id, job.m_filename, isSaved, false);
+            return;
+        }
+    }
+}
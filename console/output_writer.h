@@ -0,0 +1,91 @@
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "file_transfer.h"
+
+// Writes the outputs of the tasks on its own threads, so the server thread does not wait for the disk.
+// The output is written to the temporary file and replaces the old one by the rename. The output
+// with the same content is not replaced, the old file keeps its time. The files committed together
+// are synced in one batch before they are renamed. All jobs of one file go to one thread in order.
+// The local task writes its output to the temporary file itself, the writer only syncs and renames it.
+// The output restored from the action cache is copied, the entry stays in the cache.
+// It is used from the server thread
+class OutputWriter
+{
+public:
+    struct Result
+    {
+        uint32_t m_id = 0;
+        std::string m_filename = ""; // it is empty, if the file is not received
+        bool m_isSaved = false;
+        bool m_isUnchanged = false;
+    };
+
+public:
+    OutputWriter(size_t threads);
+    virtual ~OutputWriter();
+
+    // returns the key of the new temporary file, the speculative copies write to the different files
+    uint64_t open(const std::string& filename);
+    void write(uint64_t key, uint64_t offset, std::string&& data);
+    void finish(uint64_t key, const std::string& digest);
+    void commit(uint64_t key, uint32_t id);
+    void drop(uint64_t key);
+
+    // the whole output of the old daemon
+    void save(uint32_t id, const std::string& filename, std::string&& data);
+    // the output of the local task, the tool has written it to the temporary file
+    void move(uint32_t id, const std::string& from, const std::string& filename);
+    // the output of the action cache
+    void copy(uint32_t id, const std::string& from, const std::string& filename);
+
+    std::vector<Result> takeReady();
+
+private:
+    struct Job
+    {
+        enum Type { Open, Write, Finish, Commit, Drop, Save, Move, Copy };
+
+        Type m_type = Open;
+        uint64_t m_key = 0;
+        uint32_t m_id = 0;
+        uint64_t m_offset = 0;
+        std::string m_filename = "";
+        std::string m_data = "";
+    };
+
+    struct Worker
+    {
+        std::mutex m_mutex;
+        std::condition_variable m_event;
+        std::deque<Job> m_jobs;
+        std::unordered_map<uint64_t, std::unique_ptr<ChunkWriter>> m_files; // used by the worker thread only
+        std::thread m_thread;
+        bool m_isStopped = false;
+    };
+
+    void push(Job&& job);
+    void work(Worker& worker);
+    void apply(Worker& worker, Job& job, std::vector<std::pair<uint32_t, std::unique_ptr<ChunkWriter>>>& commits);
+    void ready(uint32_t id, const std::string& filename, bool isSaved, bool isUnchanged);
+
+    static bool hashFile(const std::string& filename, std::string& digest);
+    static bool isSame(const std::string& filename, uint64_t size, const std::string& digest);
+    static bool syncFile(const std::string& filename);
+
+private:
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    uint64_t m_countKeys = 0;
+
+    std::mutex m_readyMutex;
+    std::vector<Result> m_ready;
+};
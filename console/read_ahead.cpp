@@ -0,0 +1,296 @@
+
+#include "read_ahead.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+#include "fileex.h"
+
+#include "file_transfer.h"
+#include "sha256.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const size_t knownLimit = 1 << 16;
+}
+
+ReadAhead::ReadAhead(size_t threads, uint64_t budget) :
+    m_budget(budget)
+{
+    for (size_t ii = 0; ii < threads; ++ii)
+    {
+        m_threads.emplace_back(&ReadAhead::work, this);
+    }
+}
+
+ReadAhead::~ReadAhead()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_isStopped = true;
+    }
+
+    m_event.notify_all();
+
+    for (auto& thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+void ReadAhead::request(std::vector<Request>& requests)
+{
+    if (requests.empty())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_requests.insert(m_requests.end(), std::make_move_iterator(requests.begin()), std::make_move_iterator(requests.end()));
+    }
+
+    requests.clear();
+    m_event.notify_all();
+}
+
+std::vector<ReadAhead::Result> ReadAhead::takeReady()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    return std::move(m_ready);
+}
+
+bool ReadAhead::reserve(uint64_t size)
+{
+    uint64_t held = m_held;
+
+    do
+    {
+        if (held + size > m_budget)
+        {
+            return false;
+        }
+    }
+    while (!m_held.compare_exchange_weak(held, held + size));
+
+    return true;
+}
+
+void ReadAhead::work()
+{
+    std::string buffer;
+
+    while (true)
+    {
+        Request request;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            m_event.wait(lock, [this] { return m_isStopped || m_requests.size(); });
+            if (m_isStopped)
+            {
+                return;
+            }
+
+            request = std::move(m_requests.front());
+            m_requests.pop_front();
+        }
+
+        Result result;
+
+        result.m_id = request.m_id;
+        result.m_blob = request.m_blob;
+
+        // the content of the requested blob is checked by its hash before the upload
+        if (!request.m_isWhole)
+        {
+            readHead(request.m_filename, request.m_blob.size(), result, buffer);
+        }
+        else
+        {
+            readWhole(request.m_filename, result);
+        }
+
+        for (const auto& input : request.m_inputs)
+        {
+            result.m_inputs.push_back(hashFile(input, buffer));
+        }
+
+        if (request.m_tool.size())
+        {
+            result.m_tool = hashFile(request.m_tool, buffer);
+        }
+
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_ready.push_back(std::move(result));
+    }
+}
+
+void ReadAhead::readHead(const std::string& filename, bool isHashed, Result& result, std::string& buffer)
+{
+    std::error_code ec;
+
+    result.m_size = fs::file_size(filename, ec);
+    if (!ec)
+    {
+        result.m_time = fs::last_write_time(filename, ec);
+    }
+
+    std::ifstream file(filename, std::ios::binary);
+
+    if (ec || !file.is_open())
+    {
+        return;
+    }
+
+    result.m_isLoaded = true;
+    result.m_hash = findKnown(filename, result.m_time, result.m_size);
+
+    if (isHashed && result.m_hash.empty() && result.m_size > FileTransfer::chunkSize)
+    {
+        result.m_hash = hashFile(filename, buffer).m_hash;
+    }
+
+    // the small file is read whole, so it is hashed by the same read
+    auto headSize = std::min<uint64_t>(result.m_size, FileTransfer::chunkSize);
+    bool isWhole = result.m_size <= FileTransfer::chunkSize && result.m_hash.empty();
+    bool isHead = headSize && reserve(headSize);
+
+    if (!isHead && !isWhole)
+    {
+        return;
+    }
+
+    buffer.resize(static_cast<size_t>(headSize));
+    file.read(buffer.data(), buffer.size());
+
+    // the file is changed while it is read, the upload reads it again
+    if (static_cast<uint64_t>(file.gcount()) != headSize)
+    {
+        if (isHead)
+        {
+            release(headSize);
+        }
+        return;
+    }
+
+    if (isWhole)
+    {
+        Sha256 sha;
+
+        sha.update(buffer.data(), buffer.size());
+        result.m_hash = sha.final();
+    }
+
+    if (isHead)
+    {
+        result.m_head.assign(buffer.data(), buffer.size());
+    }
+}
+
+void ReadAhead::readWhole(const std::string& filename, Result& result)
+{
+    std::error_code ec;
+
+    result.m_isWhole = true;
+    result.m_time = fs::last_write_time(filename, ec);
+
+    if (ec || su::fs::load(filename, result.m_head) != su::fs::OK)
+    {
+        result.m_head.clear();
+        return;
+    }
+
+    // the data is sent at once, it is held out of the budget
+    result.m_isLoaded = true;
+    result.m_size = result.m_head.size();
+    result.m_hash = Sha256::get(result.m_head);
+    m_held += result.m_size;
+}
+
+ReadAhead::File ReadAhead::hashFile(const std::string& filename, std::string& buffer)
+{
+    File file;
+    std::error_code ec;
+
+    file.m_filename = filename;
+    file.m_size = fs::file_size(filename, ec);
+
+    if (!ec)
+    {
+        file.m_time = fs::last_write_time(filename, ec);
+    }
+
+    if (ec)
+    {
+        return file;
+    }
+
+    file.m_hash = findKnown(filename, file.m_time, file.m_size);
+    if (file.m_hash.size())
+    {
+        return file;
+    }
+
+    std::ifstream stream(filename, std::ios::binary);
+    Sha256 sha;
+
+    buffer.resize(FileTransfer::chunkSize);
+
+    while (stream)
+    {
+        stream.read(buffer.data(), buffer.size());
+        sha.update(buffer.data(), static_cast<size_t>(stream.gcount()));
+    }
+
+    if (!stream.is_open() || stream.bad())
+    {
+        return file;
+    }
+
+    file.m_hash = sha.final();
+    remember(file);
+
+    return file;
+}
+
+std::string ReadAhead::findKnown(const std::string& filename, fs::file_time_type time, uint64_t size)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    auto it = m_knownIndex.find(filename);
+    if (it == m_knownIndex.end() || it->second->m_time != time || it->second->m_size != size)
+    {
+        return "";
+    }
+
+    m_known.splice(m_known.begin(), m_known, it->second);
+
+    return it->second->m_hash;
+}
+
+void ReadAhead::remember(const File& file)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    auto it = m_knownIndex.find(file.m_filename);
+    if (it != m_knownIndex.end())
+    {
+        m_known.erase(it->second);
+    }
+
+    m_known.push_front(file);
+    m_knownIndex[file.m_filename] = m_known.begin();
+
+    // the coordinator runs many builds, the least used files are forgotten
+    while (m_known.size() > knownLimit)
+    {
+        m_knownIndex.erase(m_known.back().m_filename);
+        m_known.pop_back();
+    }
+}
@@ -0,0 +1,94 @@
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Reads the inputs of the next tasks of the queue on its own threads, so the server thread does not wait for the disk.
+// The requests are read in order of the queue. The first chunk of the input is kept in the memory while the held
+// bytes are in the budget. The input within one chunk is hashed by this read, the bigger one is hashed by its upload,
+// so it is not read twice. The other inputs of the tasks are hashed too, the file shared by many tasks is hashed
+// once while its size and time are the same. The last used files are remembered, the uploaded inputs too.
+// The other input requested by the daemon is read as the input of a task, it has the blob hash and no id.
+// The old daemon gets the whole input in the task, such a request reads the whole file over the budget.
+// It is used from the server thread
+class ReadAhead
+{
+public:
+    struct Request
+    {
+        uint32_t m_id = 0;
+        std::string m_filename = "";
+        std::vector<std::string> m_inputs;
+        std::string m_blob = "";
+        bool m_isWhole = false;
+        std::string m_tool = ""; // the application of the task, it is hashed for the action cache
+    };
+
+    // the hash is empty, if the file can not be read
+    struct File
+    {
+        std::string m_filename = "";
+        std::string m_hash = "";
+        uint64_t m_size = 0;
+        std::filesystem::file_time_type m_time;
+    };
+
+    // the hash of the input bigger than one chunk is empty, if the file is not known
+    struct Result
+    {
+        uint32_t m_id = 0;
+        bool m_isLoaded = false;
+        std::string m_hash = "";
+        uint64_t m_size = 0;
+        std::filesystem::file_time_type m_time;
+        std::string m_head = ""; // the whole small file or the first chunk of the big one, it may be empty
+        std::vector<File> m_inputs;
+        std::string m_blob = "";
+        bool m_isWhole = false; // the head is the whole file
+        File m_tool;
+    };
+
+public:
+    ReadAhead(size_t threads, uint64_t budget);
+    virtual ~ReadAhead();
+
+    void request(std::vector<Request>& requests);
+    std::vector<Result> takeReady();
+
+    // the head is sent or dropped
+    void release(uint64_t size) { m_held -= size; }
+    uint64_t held() const { return m_held; }
+
+    // the hash of the uploaded input, the next read of the same file does not hash it
+    void remember(const File& file);
+
+private:
+    void work();
+    bool reserve(uint64_t size);
+    void readHead(const std::string& filename, bool isHashed, Result& result, std::string& buffer);
+    void readWhole(const std::string& filename, Result& result);
+    File hashFile(const std::string& filename, std::string& buffer);
+    std::string findKnown(const std::string& filename, std::filesystem::file_time_type time, uint64_t size);
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_event;
+    std::deque<Request> m_requests;
+    std::vector<Result> m_ready;
+    std::list<File> m_known; // the last used is at the front
+    std::unordered_map<std::string, std::list<File>::iterator> m_knownIndex;
+    std::vector<std::thread> m_threads;
+    bool m_isStopped = false;
+
+    uint64_t m_budget = 0;
+    std::atomic<uint64_t> m_held = 0;
+};
@@ -0,0 +1,186 @@
+
+#include "task_graph.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "log.h"
+#include "stringex.h"
+
+#include "console.h"
+
+bool TaskGraph::build(std::deque<TaskInfo>& tasks)
+{
+    std::vector<TaskInfo*> order;
+
+    if (!resolve(tasks) || !sort(tasks, order))
+    {
+        return false;
+    }
+
+    // from the end of the build, the dependents are already calculated
+    uint64_t critical = 0;
+    for (auto it = order.rbegin(); it != order.rend(); ++it)
+    {
+        uint64_t tail = 0;
+
+        for (auto dependent : (*it)->m_dependents)
+        {
+            tail = std::max(tail, dependent->m_priority);
+        }
+
+        (*it)->m_priority += tail;
+        (*it)->m_waiting = (*it)->m_dependencies.size();
+        critical = std::max(critical, (*it)->m_priority);
+    }
+
+    if (m_countEdges)
+    {
+        LOGN("Built the task graph: %llu dependencies, the critical path is %llu ms", m_countEdges, critical);
+    }
+
+    return true;
+}
+
+bool TaskGraph::resolve(std::deque<TaskInfo>& tasks)
+{
+    std::unordered_map<uint32_t, TaskInfo*> byId;
+    std::unordered_map<std::string, std::vector<TaskInfo*>> byName;
+    std::unordered_map<std::string, TaskInfo*> byOutput;
+
+    // the id in the build set, the coordinator has the other ids of the tasks
+    for (size_t ii = 0; ii < tasks.size(); ++ii)
+    {
+        byId[static_cast<uint32_t>(ii + 1)] = &tasks[ii];
+    }
+
+    for (auto& task : tasks)
+    {
+        byOutput[su::String_tolower(task.m_vars.OutputFile)] = &task;
+
+        if (!task.m_name.empty())
+        {
+            byName[task.m_name].push_back(&task);
+        }
+    }
+
+    for (auto& task : tasks)
+    {
+        for (const auto& token : task.m_dependsOn)
+        {
+            std::vector<TaskInfo*> found;
+
+            if (byName.contains(token))
+            {
+                found = byName[token];
+            }
+            else if (byOutput.contains(su::String_tolower(token)))
+            {
+                found.push_back(byOutput[su::String_tolower(token)]);
+            }
+            else if (token.size() < 10 && token.find_first_not_of("0123456789") == std::string::npos &&
+                     byId.contains(std::stoul(token)))
+            {
+                found.push_back(byId[std::stoul(token)]);
+            }
+
+            if (found.empty())
+            {
+                LOGE("Task %u '%s': unknown dependency '%s'", task.m_message.id(), task.m_name.c_str(), token.c_str());
+                return false;
+            }
+
+            for (auto dependency : found)
+            {
+                if (std::find(task.m_dependencies.begin(), task.m_dependencies.end(), dependency) != task.m_dependencies.end())
+                {
+                    continue;
+                }
+
+                task.m_dependencies.push_back(dependency);
+                dependency->m_dependents.push_back(&task);
+                ++m_countEdges;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Kahn's algorithm, the tasks of a cycle are never ready
+bool TaskGraph::sort(std::deque<TaskInfo>& tasks, std::vector<TaskInfo*>& order) const
+{
+    std::unordered_map<const TaskInfo*, size_t> waiting;
+
+    order.clear();
+    order.reserve(tasks.size());
+
+    for (auto& task : tasks)
+    {
+        waiting[&task] = task.m_dependencies.size();
+
+        if (task.m_dependencies.empty())
+        {
+            order.push_back(&task);
+        }
+    }
+
+    for (size_t ii = 0; ii < order.size(); ++ii)
+    {
+        for (auto dependent : order[ii]->m_dependents)
+        {
+            if (!--waiting[dependent])
+            {
+                order.push_back(dependent);
+            }
+        }
+    }
+
+    if (order.size() == tasks.size())
+    {
+        return true;
+    }
+
+    for (const auto& task : tasks)
+    {
+        if (waiting[&task])
+        {
+            LOGE("Task %u '%s' (%s) is in a dependency cycle",
+                 task.m_message.id(), task.m_name.c_str(), task.m_vars.SourceFile.c_str());
+        }
+    }
+
+    LOGE("Found a dependency cycle, %llu tasks can not be started", tasks.size() - order.size());
+    return false;
+}
+
+std::vector<const TaskInfo*> TaskGraph::realisedPath(const std::deque<TaskInfo>& tasks)
+{
+    std::vector<const TaskInfo*> out;
+    const TaskInfo* last = nullptr;
+
+    for (const auto& task : tasks)
+    {
+        if (task.m_state == TaskState::Done && (!last || task.m_finishTime > last->m_finishTime))
+        {
+            last = &task;
+        }
+    }
+
+    // the latest finished dependency has released the task
+    while (last)
+    {
+        out.push_back(last);
+
+        auto it = std::max_element(last->m_dependencies.begin(), last->m_dependencies.end(),
+            [](const TaskInfo* a, const TaskInfo* b)
+            {
+                return a->m_finishTime < b->m_finishTime;
+            });
+
+        last = it != last->m_dependencies.end() ? *it : nullptr;
+    }
+
+    std::reverse(out.begin(), out.end());
+    return out;
+}
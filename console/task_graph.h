@@ -0,0 +1,33 @@
+
+#pragma once
+
+#include <deque>
+#include <string>
+#include <vector>
+
+struct TaskInfo;
+
+// Dependencies of the tasks. The task waits for its dependencies, the priority is the expected time of the longest
+// path from the task to the end of the build, so the critical path goes first
+class TaskGraph
+{
+public:
+    TaskGraph() = default;
+    virtual ~TaskGraph() = default;
+
+    // resolves the dependencies, checks cycles and sets the critical path priorities.
+    // The priorities must be predicted before as the expected times of the tasks, ms
+    bool build(std::deque<TaskInfo>& tasks);
+
+    bool empty() const { return !m_countEdges; }
+
+    // the chain of the finished tasks which has defined the end of the build
+    static std::vector<const TaskInfo*> realisedPath(const std::deque<TaskInfo>& tasks);
+
+private:
+    bool resolve(std::deque<TaskInfo>& tasks);
+    bool sort(std::deque<TaskInfo>& tasks, std::vector<TaskInfo*>& order) const;
+
+private:
+    size_t m_countEdges = 0;
+};
@@ -0,0 +1,123 @@
+
+#include "task_history.h"
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "log.h"
+
+#pragma warning(disable:4251)
+#include "master.pb.h"
+#pragma warning(default:4251)
+
+std::string TaskHistory::key(const Master::Task& message)
+{
+    return message.project() + "|" + message.sourcefile() + "|" + message.application();
+}
+
+bool TaskHistory::load(const std::string& filename)
+{
+    std::ifstream file(filename);
+
+    if (!file.is_open())
+    {
+        LOGW("The task history '%s' not found", filename.c_str());
+        return false;
+    }
+
+    // duration, size, host, hash, key. The first version has no host and hash
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::vector<std::string> fields;
+        std::istringstream ss(line);
+
+        for (std::string field; std::getline(ss, field, '\t'); )
+        {
+            fields.push_back(field);
+        }
+
+        if (fields.size() != 3 && fields.size() != 5)
+        {
+            continue;
+        }
+
+        Item item;
+
+        item.m_duration = static_cast<uint32_t>(std::strtoul(fields[0].c_str(), nullptr, 10));
+        item.m_size = std::strtoull(fields[1].c_str(), nullptr, 10);
+
+        if (fields.size() == 5)
+        {
+            item.m_host = fields[2] == "-" ? "" : fields[2];
+            item.m_hash = fields[3] == "-" ? "" : fields[3];
+        }
+
+        if (!fields.back().empty())
+        {
+            m_items[fields.back()] = item;
+        }
+    }
+
+    LOGN("Loaded %u items of the task history '%s'", m_items.size(), filename.c_str());
+    return true;
+}
+
+bool TaskHistory::save(const std::string& filename) const
+{
+    std::ofstream file(filename, std::ios::trunc);
+
+    if (!file.is_open())
+    {
+        LOGE("Can not save the task history '%s'", filename.c_str());
+        return false;
+    }
+
+    for (const auto& [key, item] : m_items)
+    {
+        file << item.m_duration << "\t" << item.m_size << "\t"
+             << (item.m_host.empty() ? "-" : item.m_host) << "\t"
+             << (item.m_hash.empty() ? "-" : item.m_hash) << "\t"
+             << key << "\n";
+    }
+
+    return true;
+}
+
+const TaskHistory::Item* TaskHistory::get(const std::string& key) const
+{
+    auto it = m_items.find(key);
+
+    return it != m_items.end() ? &it->second : nullptr;
+}
+
+void TaskHistory::set(const std::string& key, uint32_t duration, uint64_t size, const std::string& host, const std::string& hash)
+{
+    auto it = m_items.find(key);
+
+    // smooth the noise of the loaded workstations
+    if (it != m_items.end() && it->second.m_size == size)
+    {
+        it->second.m_duration = (it->second.m_duration + duration) / 2;
+        it->second.m_host = host;
+        it->second.m_hash = hash;
+        return;
+    }
+
+    m_items[key] = {duration, size, host, hash};
+}
+
+double TaskHistory::getTimePerByte() const
+{
+    double duration = 0;
+    double size = 0;
+
+    for (const auto& [key, item] : m_items)
+    {
+        duration += item.m_duration;
+        size += static_cast<double>(item.m_size);
+    }
+
+    return size > 0 ? duration / size : 0.0;
+}
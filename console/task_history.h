@@ -0,0 +1,41 @@
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+namespace Master
+{
+class Task;
+}
+
+// Wall time of the finished tasks from the previous builds. The key is project + source file + application
+class TaskHistory
+{
+public:
+    struct Item
+    {
+        uint32_t m_duration = 0; // ms
+        uint64_t m_size = 0;     // size of the source file
+        std::string m_host = ""; // the last host, it may have the input in its cache
+        std::string m_hash = ""; // sha256 of the input, hex
+    };
+
+public:
+    TaskHistory() = default;
+    virtual ~TaskHistory() = default;
+
+    static std::string key(const Master::Task& message);
+
+    bool load(const std::string& filename);
+    bool save(const std::string& filename) const;
+
+    const Item* get(const std::string& key) const;
+    void set(const std::string& key, uint32_t duration, uint64_t size, const std::string& host, const std::string& hash);
+
+    bool empty() const { return m_items.empty(); }
+    double getTimePerByte() const;
+
+private:
+    std::unordered_map<std::string, Item> m_items;
+};
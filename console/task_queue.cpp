@@ -0,0 +1,391 @@
+
+#include "task_queue.h"
+
+#include <algorithm>
+
+#include "console.h"
+#include "global_constants.h"
+#include "tcp_protobufnode.h"
+
+bool TaskQueue::PendingOrder::operator()(const TaskInfo* a, const TaskInfo* b) const
+{
+    if (a->m_priority != b->m_priority)
+    {
+        return a->m_priority > b->m_priority;
+    }
+
+    return a->m_message.id() < b->m_message.id();
+}
+
+bool TaskQueue::push(TaskInfo* task)
+{
+    m_index[task->m_message.id()] = task;
+
+    return insertPending(task);
+}
+
+TaskInfo* TaskQueue::pop(const TcpProtobufNode* node, bool isShortest)
+{
+    if (m_builds.size() > 1)
+    {
+        return popFair(node, isShortest);
+    }
+
+    auto task = m_builds.size() ? findBest(m_builds.begin()->second, node, isShortest) : nullptr;
+
+    if (task)
+    {
+        erasePending(task);
+    }
+
+    return task;
+}
+
+// the builds are taken in order of their in-flight tasks, each one by its own indexes
+TaskInfo* TaskQueue::popFair(const TcpProtobufNode* node, bool isShortest)
+{
+    std::vector<std::pair<size_t, uint32_t>> order;
+
+    for (const auto& [build, pending] : m_builds)
+    {
+        if (pending.m_tasks.size())
+        {
+            auto inFlight = m_buildInFlight.find(build);
+            order.push_back({inFlight != m_buildInFlight.end() ? inFlight->second : 0, build});
+        }
+    }
+
+    std::sort(order.begin(), order.end());
+
+    for (const auto& [inFlight, build] : order)
+    {
+        auto task = findBest(m_builds[build], node, isShortest);
+
+        if (task)
+        {
+            erasePending(task);
+            return task;
+        }
+    }
+
+    return nullptr;
+}
+
+TaskInfo* TaskQueue::findBest(const Pending& pending, const TcpProtobufNode* node, bool isShortest) const
+{
+    auto affinity = pending.m_affinity.find(node->m_host);
+    TaskInfo* task = nullptr;
+
+    if (affinity != pending.m_affinity.end())
+    {
+        task = findHead(affinity->second, node, isShortest);
+    }
+
+    // the old daemon does not report its projects
+    if (!task)
+    {
+        task = node->m_projects.empty() ? findIn(pending.m_tasks, node, isShortest) : findHead(pending.m_projects, node, isShortest);
+    }
+
+    return task;
+}
+
+// the best of the heads of the supported projects, the node does not scan the tasks it can not run
+TaskInfo* TaskQueue::findHead(const ProjectSets& projects, const TcpProtobufNode* node, bool isShortest) const
+{
+    PendingOrder order;
+    TaskInfo* task = nullptr;
+
+    auto choose = [&](const TaskSet& tasks)
+    {
+        auto candidate = findIn(tasks, node, isShortest);
+
+        if (candidate && (!task || order(candidate, task) != isShortest))
+        {
+            task = candidate;
+        }
+    };
+
+    if (node->m_projects.empty())
+    {
+        for (const auto& [project, tasks] : projects)
+        {
+            choose(tasks);
+        }
+
+        return task;
+    }
+
+    for (const auto& project : node->m_projects)
+    {
+        auto tasks = projects.find(project);
+
+        if (tasks != projects.end())
+        {
+            choose(tasks->second);
+        }
+    }
+
+    return task;
+}
+
+TaskInfo* TaskQueue::findIn(const TaskSet& pending, const TcpProtobufNode* node, bool isShortest) const
+{
+    // only the retried tasks have the failed hosts, so there are few skipped ones
+    auto accept = [node](const TaskInfo* task)
+    {
+        return !task->m_failedHosts.contains(node->m_host) && isCapable(node, task);
+    };
+
+    if (isShortest)
+    {
+        auto it = std::find_if(pending.rbegin(), pending.rend(), accept);
+        return it != pending.rend() ? *it : nullptr;
+    }
+
+    auto it = std::find_if(pending.begin(), pending.end(), accept);
+    return it != pending.end() ? *it : nullptr;
+}
+
+bool TaskQueue::insertPending(TaskInfo* task)
+{
+    // the new task is pending already, the dispatched one goes back
+    if (task->m_state != TaskState::Pending && !task->moveTo(TaskState::Pending))
+    {
+        return false;
+    }
+
+    auto& pending = m_builds[task->m_build];
+
+    m_pending.insert(task);
+    pending.m_tasks.insert(task);
+    pending.m_projects[task->m_message.project()].insert(task);
+
+    if (!task->m_affinity.empty())
+    {
+        pending.m_affinity[task->m_affinity][task->m_message.project()].insert(task);
+    }
+
+    return true;
+}
+
+void TaskQueue::erasePending(TaskInfo* task)
+{
+    auto& pending = m_builds[task->m_build];
+
+    m_pending.erase(task);
+    pending.m_tasks.erase(task);
+    pending.m_projects[task->m_message.project()].erase(task);
+
+    if (!task->m_affinity.empty())
+    {
+        auto it = pending.m_affinity.find(task->m_affinity);
+
+        if (it != pending.m_affinity.end())
+        {
+            it->second[task->m_message.project()].erase(task);
+        }
+    }
+}
+
+TaskInfo* TaskQueue::find(uint32_t id) const
+{
+    auto it = m_index.find(id);
+
+    return it != m_index.end() ? it->second : nullptr;
+}
+
+bool TaskQueue::assign(TcpProtobufNode* node, TaskInfo* task)
+{
+    auto& ids = m_inFlight[node];
+
+    if (ids.contains(task->m_message.id()))
+    {
+        return true;
+    }
+
+    // the speculative copy does not change the state
+    if (task->m_copies ? task->isFinished() : !task->moveTo(TaskState::Dispatched))
+    {
+        return false;
+    }
+
+    ids.insert(task->m_message.id());
+    ++task->m_copies;
+    ++m_buildInFlight[task->m_build];
+    ++m_countInFlight;
+
+    return true;
+}
+
+TaskInfo* TaskQueue::unassign(TcpProtobufNode* node, uint32_t id)
+{
+    auto it = m_inFlight.find(node);
+
+    if (it == m_inFlight.end() || !it->second.erase(id))
+    {
+        return nullptr;
+    }
+
+    --m_countInFlight;
+
+    auto task = find(id);
+    if (task)
+    {
+        --task->m_copies;
+        --m_buildInFlight[task->m_build];
+    }
+
+    return task;
+}
+
+std::vector<TcpProtobufNode*> TaskQueue::unassignAll(uint32_t id)
+{
+    std::vector<TcpProtobufNode*> out;
+
+    for (auto& [node, ids] : m_inFlight)
+    {
+        if (ids.erase(id))
+        {
+            out.push_back(node);
+        }
+    }
+
+    m_countInFlight -= out.size();
+
+    auto task = find(id);
+    if (task)
+    {
+        task->m_copies = 0;
+        m_buildInFlight[task->m_build] -= out.size();
+    }
+
+    return out;
+}
+
+std::vector<TaskInfo*> TaskQueue::releaseNode(TcpProtobufNode* node)
+{
+    std::vector<TaskInfo*> out;
+    auto it = m_inFlight.find(node);
+
+    if (it == m_inFlight.end())
+    {
+        return out;
+    }
+
+    for (auto id : it->second)
+    {
+        auto task = find(id);
+
+        if (task)
+        {
+            --m_buildInFlight[task->m_build];
+        }
+
+        // the task is still running on another node as the speculative copy
+        if (task && !--task->m_copies && insertPending(task))
+        {
+            out.push_back(task);
+        }
+    }
+
+    m_countInFlight -= it->second.size();
+    m_inFlight.erase(it);
+
+    return out;
+}
+
+bool TaskQueue::isCapable(const TcpProtobufNode* node, const TaskInfo* task)
+{
+    // the old daemon does not send the other outputs back, the task waits for the newer one
+    if (task->m_message.outputs_size() && node->m_protocol < Global::protocolOutputSet)
+    {
+        return false;
+    }
+
+    return node->isSupported(task->m_message.project());
+}
+
+size_t TaskQueue::countInFlight(TcpProtobufNode* node) const
+{
+    auto it = m_inFlight.find(node);
+
+    return it != m_inFlight.end() ? it->second.size() : 0;
+}
+
+bool TaskQueue::isAssigned(TcpProtobufNode* node, uint32_t id) const
+{
+    auto it = m_inFlight.find(node);
+
+    return it != m_inFlight.end() && it->second.contains(id);
+}
+
+std::vector<TaskInfo*> TaskQueue::top(size_t count) const
+{
+    std::vector<TaskInfo*> out;
+
+    for (auto it = m_pending.begin(); it != m_pending.end() && out.size() < count; ++it)
+    {
+        out.push_back(*it);
+    }
+
+    return out;
+}
+
+bool TaskQueue::cancel(TaskInfo* task)
+{
+    if (!m_pending.contains(task))
+    {
+        return false;
+    }
+
+    erasePending(task);
+
+    return true;
+}
+
+std::vector<std::pair<TcpProtobufNode*, uint32_t>> TaskQueue::removeBuild(uint32_t build)
+{
+    std::vector<std::pair<TcpProtobufNode*, uint32_t>> out;
+
+    // the failed build may have pending tasks
+    auto pending = m_builds.find(build);
+    if (pending != m_builds.end())
+    {
+        auto tasks = pending->second.m_tasks;
+
+        for (auto task : tasks)
+        {
+            erasePending(task);
+        }
+    }
+
+    // the copies in flight are forgotten before the index, the pointers must not outlive the build
+    for (auto& [node, ids] : m_inFlight)
+    {
+        for (auto it = ids.begin(); it != ids.end(); )
+        {
+            auto task = find(*it);
+
+            if (!task || task->m_build != build)
+            {
+                ++it;
+                continue;
+            }
+
+            out.push_back({node, *it});
+            --m_countInFlight;
+            it = ids.erase(it);
+        }
+    }
+
+    for (auto it = m_index.begin(); it != m_index.end(); )
+    {
+        it = it->second->m_build == build ? m_index.erase(it) : std::next(it);
+    }
+
+    m_builds.erase(build);
+    m_buildInFlight.erase(build);
+
+    return out;
+}
@@ -0,0 +1,90 @@
+
+#pragma once
+
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct TaskInfo;
+class TcpProtobufNode;
+
+// Task table of the server. Keeps the undispatched tasks ordered by priority, the index by task id and
+// the set of in-flight tasks of the every node, so that dispatch, result and node loss do not scan all tasks.
+// The host gets the tasks it ran in the previous build first, it may have their inputs in the cache.
+// The node gets only the tasks of the projects it supports.
+// There are several builds in the coordinator, the build with the fewest in-flight tasks goes first.
+// Every build has its own indexes, so the dispatch of several builds does not scan their tasks.
+// Is not thread safe, it must be used only from the server thread.
+class TaskQueue
+{
+public:
+    TaskQueue() = default;
+    virtual ~TaskQueue() = default;
+
+    // false, if the task is finished, it is not queued again
+    bool push(TaskInfo* task);
+    TaskInfo* pop(const TcpProtobufNode* node, bool isShortest = false);
+
+    TaskInfo* find(uint32_t id) const;
+
+    // false, if the task is finished
+    bool assign(TcpProtobufNode* node, TaskInfo* task);
+    TaskInfo* unassign(TcpProtobufNode* node, uint32_t id);
+    std::vector<TcpProtobufNode*> unassignAll(uint32_t id);
+    std::vector<TaskInfo*> releaseNode(TcpProtobufNode* node);
+
+    // the pending task is taken out of the queue, it is not dispatched anymore
+    bool cancel(TaskInfo* task);
+    std::vector<TaskInfo*> pending() const { return {m_pending.begin(), m_pending.end()}; }
+
+    // the next pending tasks in order of the priority
+    std::vector<TaskInfo*> top(size_t count) const;
+
+    // forgets the finished build, its tasks may be deleted after that.
+    // Returns the nodes and the ids of its copies in flight, they are cancelled by the caller
+    std::vector<std::pair<TcpProtobufNode*, uint32_t>> removeBuild(uint32_t build);
+
+    // the node supports the project and the features of the task
+    static bool isCapable(const TcpProtobufNode* node, const TaskInfo* task);
+
+    size_t countPending() const { return m_pending.size(); }
+    size_t countInFlight(TcpProtobufNode* node) const;
+    bool isAssigned(TcpProtobufNode* node, uint32_t id) const;
+    size_t countInFlight() const { return m_countInFlight; }
+
+    const std::unordered_map<TcpProtobufNode*, std::unordered_set<uint32_t>>& inFlight() const { return m_inFlight; }
+
+private:
+    struct PendingOrder
+    {
+        bool operator()(const TaskInfo* a, const TaskInfo* b) const;
+    };
+
+    using TaskSet = std::set<TaskInfo*, PendingOrder>;
+    using ProjectSets = std::unordered_map<std::string, TaskSet>;
+
+    // the pending tasks of one build and their indexes
+    struct Pending
+    {
+        TaskSet m_tasks;
+        std::unordered_map<std::string, ProjectSets> m_affinity; // by the host of the previous build and the project
+        ProjectSets m_projects;                                  // by the project
+    };
+
+    bool insertPending(TaskInfo* task);
+    void erasePending(TaskInfo* task);
+    TaskInfo* popFair(const TcpProtobufNode* node, bool isShortest);
+    TaskInfo* findBest(const Pending& pending, const TcpProtobufNode* node, bool isShortest) const;
+    TaskInfo* findHead(const ProjectSets& projects, const TcpProtobufNode* node, bool isShortest) const;
+    TaskInfo* findIn(const TaskSet& pending, const TcpProtobufNode* node, bool isShortest) const;
+
+private:
+    TaskSet m_pending;
+    std::unordered_map<uint32_t, Pending> m_builds; // pending tasks by the build
+    std::unordered_map<uint32_t, size_t> m_buildInFlight;
+    size_t m_countInFlight = 0;
+    std::unordered_map<uint32_t, TaskInfo*> m_index;
+    std::unordered_map<TcpProtobufNode*, std::unordered_set<uint32_t>> m_inFlight;
+};
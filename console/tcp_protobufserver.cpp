@@ -2,185 +2,1885 @@
 #include "fileex.h"
 
 #include <chrono>
+#include <filesystem>
 
 #include "tcp_protobufserver.h"
 #include "tcp_protobufnode.h"
 #include "global_constants.h"
+#include "sha256.h"
+#include "wildcard.h"
 
+namespace
+{
+    const std::chrono::milliseconds speculationPeriod(1000);
+    const std::chrono::milliseconds speculationMinTime(1000);
+    const float slowNodeRatio = 0.5f;
+    const std::chrono::seconds pingPeriod(10);
+    const size_t readAheadThreads = 2;
+    const size_t readAheadTasks = 64; // the next tasks of the queue, their inputs are read
+    const uint64_t readAheadBudget = 64 << 20;
+    const size_t writerThreads = 2;
+
+    // NTSTATUS codes of the error severity, the process was crashed
+    bool isCrashCode(int32_t code)
+    {
+        return (static_cast<uint32_t>(code) & 0xC0000000) == 0xC0000000;
+    }
+}
+
+TcpProtobufServer::TcpProtobufServer(const std::string& ip, uint16_t port, uint32_t maxClients, su::Log* plog) :
+    su::Net::TcpServer(ip, port, maxClients, plog),
+    m_readAhead(readAheadThreads, readAheadBudget),
+    m_writer(writerThreads)
+{
+    m_immediatelyCloseClients = true;
+}
+
+void TcpProtobufServer::submit(TaskInfo* task)
+{
+    std::lock_guard<std::mutex> guard(m_submitMutex);
+
+    m_submitted.push_back(task);
+}
+
+void TcpProtobufServer::setGenerated(uint32_t build)
+{
+    std::lock_guard<std::mutex> guard(m_submitMutex);
+
+    m_generated.push_back(build);
+}
+
+void TcpProtobufServer::release(uint32_t build)
+{
+    std::lock_guard<std::mutex> guard(m_submitMutex);
+
+    m_releasing.push_back(build);
+}
+
+std::vector<uint32_t> TcpProtobufServer::takeReleased()
+{
+    std::lock_guard<std::mutex> guard(m_submitMutex);
+
+    return std::move(m_released);
+}
+
+void TcpProtobufServer::takeSubmitted()
+{
+    std::vector<TaskInfo*> submitted;
+    std::vector<uint32_t> releasing;
+    std::vector<uint32_t> generated;
+
+    {
+        std::lock_guard<std::mutex> guard(m_submitMutex);
+        submitted.swap(m_submitted);
+        releasing.swap(m_releasing);
+        generated.swap(m_generated);
+    }
+
+    // the generator marks the build after its last task, so the tasks of the batch go first
+    for (auto task : submitted)
+    {
+        m_generating.insert(task->m_build);
+
+        if (task->m_waiting)
+        {
+            ++m_blocked[task->m_build];
+        }
+    }
+
+    for (auto build : generated)
+    {
+        m_generating.erase(build);
+    }
+
+    for (auto build : releasing)
+    {
+        for (const auto& [node, id] : m_queue.removeBuild(build))
+        {
+            cancelCopy(node, id);
+        }
+
+        m_generating.erase(build);
+        m_blocked.erase(build);
+        dropInputs(build);
+        std::erase_if(m_writing, [build](const auto& item) { return item.second.m_task->m_build == build; });
+    }
+
+    if (releasing.size())
+    {
+        std::lock_guard<std::mutex> guard(m_submitMutex);
+        m_released.insert(m_released.end(), releasing.begin(), releasing.end());
+    }
+
+    // the tasks are queued in order of the priority at once, the tasks with dependencies when the dependencies are done
+    for (auto task : submitted)
+    {
+        if (!task->m_waiting)
+        {
+            m_queue.push(task);
+        }
+    }
+}
+
+void TcpProtobufServer::readAhead()
+{
+    std::vector<ReadAhead::Request> requests;
+
+    // only the next tasks of the queue are read, so the held heads are dispatched first
+    for (auto task : m_queue.top(readAheadTasks))
+    {
+        if (!task->m_isRead)
+        {
+            readInput(task, requests);
+        }
+    }
+
+    m_readAhead.request(requests);
+}
+
+void TcpProtobufServer::readInput(TaskInfo* task, std::vector<ReadAhead::Request>& requests)
+{
+    task->m_isRead = true;
+    m_reading[task->m_message.id()] = task;
+    requests.push_back({task->m_message.id(), task->m_vars.SourceFile, task->m_inputs});
+
+    // the application is a part of the action key, it is hashed with the input
+    if (m_actionCache)
+    {
+        requests.back().m_tool = ActionCache::toolPath(*task);
+    }
+}
+
+void TcpProtobufServer::takeInputs()
+{
+    for (auto& input : m_readAhead.takeReady())
+    {
+        if (input.m_blob.size())
+        {
+            takeBlob(input);
+            continue;
+        }
+
+        if (input.m_isWhole)
+        {
+            takeLoaded(input);
+            continue;
+        }
+
+        auto it = m_reading.find(input.m_id);
+
+        // the build is released
+        if (it == m_reading.end())
+        {
+            m_readAhead.release(input.m_head.size());
+            continue;
+        }
+
+        auto task = it->second;
+        m_reading.erase(it);
+
+        // the task may be dispatched before its input is read, it reads the file by the upload then
+        bool isQueued = task->m_state == TaskState::Pending;
+
+        if (!isQueued)
+        {
+            m_readAhead.release(input.m_head.size());
+            input.m_head.clear();
+        }
+
+        // the missing input is not sent, the task fails by its upload
+        if (input.m_isLoaded && !task->isFinished())
+        {
+            task->m_inputSize = input.m_size;
+            m_heads[input.m_id] = {task->m_build, std::move(input.m_head), input.m_time};
+        }
+        else
+        {
+            m_readAhead.release(input.m_head.size());
+        }
+
+        addManifest(task, input.m_inputs);
+        task->m_toolHash = input.m_tool.m_hash;
+
+        if (input.m_hash.size())
+        {
+            setInputHash(task, input.m_hash);
+        }
+
+        if (isQueued)
+        {
+            restoreFromCache(task);
+        }
+    }
+}
+
+void TcpProtobufServer::setInputHash(TaskInfo* task, const std::string& hash)
+{
+    task->m_inputHash = hash;
+
+    // the dependents use the key of the task in their keys
+    if (m_actionCache)
+    {
+        task->m_actionKey = m_actionCache->key(*task);
+    }
+}
+
+void TcpProtobufServer::addManifest(TaskInfo* task, const std::vector<ReadAhead::File>& inputs)
+{
+    task->m_message.clear_inputs();
+
+    for (const auto& file : inputs)
+    {
+        // the missing input is not sent, the task fails on the daemon
+        if (file.m_hash.empty())
+        {
+            LOGSPE(getLog(), "Can not read the input '%s' of task %u", file.m_filename.c_str(), task->m_message.id());
+            continue;
+        }
+
+        auto path = su::String_replace(file.m_filename, task->m_vars.PDir, "$(pdir)", true);
+        if (path == file.m_filename)
+        {
+            LOGSPW(getLog(), "The input '%s' of task %u is not in the project dir, it is not sent",
+                   file.m_filename.c_str(), task->m_message.id());
+            continue;
+        }
+
+        auto manifest = task->m_message.add_inputs();
+
+        manifest->set_file(path);
+        manifest->set_hash(file.m_hash);
+        manifest->set_size(file.m_size);
+
+        m_blobFiles[file.m_hash] = file.m_filename;
+    }
+}
+
+void TcpProtobufServer::dropInput(uint32_t id)
+{
+    auto it = m_heads.find(id);
+
+    if (it != m_heads.end())
+    {
+        m_readAhead.release(it->second.m_data.size());
+        m_heads.erase(it);
+    }
+}
+
+void TcpProtobufServer::dropInputs(uint32_t build)
+{
+    std::erase_if(m_reading, [build](const auto& item) { return item.second->m_build == build; });
+
+    for (auto it = m_heads.begin(); it != m_heads.end(); )
+    {
+        if (it->second.m_build != build)
+        {
+            ++it;
+            continue;
+        }
+
+        m_readAhead.release(it->second.m_data.size());
+        it = m_heads.erase(it);
+    }
+}
+
+void TcpProtobufServer::setLocalSlots(uint32_t slots)
+{
+    m_local = slots ? std::make_unique<LocalWorker>(slots, getLog()) : nullptr;
+    updateMaxScore();
+}
+
+void TcpProtobufServer::closeAllClients()
+{
+    Master::Packet packet;
+
+    packet.mutable_system()->set_close(true);
+
+    std::lock_guard<std::mutex> guard(getMutex());
+
+    for (auto node: m_clients)
+    {
+        static_cast<TcpProtobufNode*>(node)->send(packet);
+    }
+}
+
+uint32_t TcpProtobufServer::makespan() const
+{
+    if (m_lastResult < m_firstDispatch)
+    {
+        return 0;
+    }
+
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(m_lastResult - m_firstDispatch).count());
+}
+
+void TcpProtobufServer::doWork()
+{
+    su::Net::TcpServer::doWork();
+
+    takeSubmitted();
+    takeInputs();
+    takeOutputs();
+    readAhead();
+
+    if (m_isKeepAlive)
+    {
+        keepAlive();
+    }
+
+    std::vector<TcpProtobufNode*> nodes;
+
+    nodes.reserve(m_clients.size());
+    for (auto node: m_clients)
+    {
+        nodes.push_back(static_cast<TcpProtobufNode*>(node));
+    }
+
+    if (m_isWeighted)
+    {
+        std::sort(nodes.begin(), nodes.end(), [](const TcpProtobufNode* a, const TcpProtobufNode* b)
+        {
+            return a->m_score > b->m_score;
+        });
+    }
+
+    for (auto node : nodes)
+    {
+        sendTasksToSlave(node);
+    }
+
+    sendChunks();
+
+    if (m_isHostLost)
+    {
+        failStranded();
+    }
+
+    if (m_local)
+    {
+        doLocalWork();
+    }
+
+    if (isTail())
+    {
+        sendSpeculativeTasks();
+    }
+}
+
+void TcpProtobufServer::doLocalWork()
+{
+    auto node = m_local->node();
+
+    if (m_local->takeCalibration())
+    {
+        updateMaxScore();
+    }
+
+    for (auto& result : m_local->collect())
+    {
+        applyResultFromSlave(node, result);
+    }
+
+    if (m_quarantine.contains(node->m_host))
+    {
+        return;
+    }
+
+    std::vector<TaskInfo*> skipped;
+
+    while (m_local->countFreeSlots() && skipped.size() < readAheadTasks)
+    {
+        auto task = m_queue.pop(node, isSlow(node));
+        if (!task)
+        {
+            break;
+        }
+
+        // the tool would write the output in place, so the task is left to the daemons
+        if (!LocalWorker::isRedirected(*task))
+        {
+            skipped.push_back(task);
+            continue;
+        }
+
+        if (!assignTask(node, task))
+        {
+            continue;
+        }
+
+        if (!m_local->start(task))
+        {
+            failCopy(node, task->m_message.id());
+            continue;
+        }
+
+        task->moveTo(TaskState::Running);
+    }
+
+    for (auto task : skipped)
+    {
+        m_queue.push(task);
+    }
+}
+
+void TcpProtobufServer::onClientDisconnected(su::Net::Node* node)
+{
+    auto protoNode = static_cast<TcpProtobufNode*>(node);
+
+    m_rampUp.erase(protoNode);
+    dropTransfers(protoNode);
+    updateMaxScore(protoNode);
+
+    if (protoNode->m_bytesRaw)
+    {
+        LOGSPN(getLog(), "The client %s: compression saved %llu of %llu bytes, %llu ms of CPU", protoNode->fullId().c_str(),
+               protoNode->m_bytesRaw - protoNode->m_bytesWire, protoNode->m_bytesRaw, protoNode->m_codecTime / 1000);
+    }
+
+    for (auto task : m_queue.releaseNode(protoNode))
+    {
+        LOGSPW(getLog(), "Do free the %i task because the client %s was disconnect",
+               task->m_message.id(), node->fullId().c_str());
+    }
+
+    m_isHostLost = true;
+}
+
+bool TcpProtobufServer::onRecvFromNode(su::Net::Node* node)
+{
+    auto protoNode = static_cast<TcpProtobufNode*>(node);
+
+    while (protoNode->countRecvPackets())
+    {
+        auto data = protoNode->extractRecvPacket();
+
+        Slave::Packet packet;
+
+        packet.ParseFromArray(data.raw.data(), (int)data.raw.size());
+
+        if (!packet.IsInitialized())
+        {
+            LOGSPE(getLog(), "Can not parse the slave protobuf packet");
+            return false;
+        }
+
+        if (packet.has_info())
+        {
+            protoNode->m_freeCores = packet.info().task_count() + packet.info().prefetch_count();
+            protoNode->m_protocol = packet.info().has_version() ? packet.info().version() : 1;
+            LOGSPN(getLog(), "The client %s sent %i free cores and %i prefetch slots, protocol version %u",
+                   protoNode->fullId().c_str(), packet.info().task_count(), packet.info().prefetch_count(),
+                   protoNode->m_protocol);
+
+            if (packet.info().has_score() && packet.info().score() > 0)
+            {
+                protoNode->m_score = packet.info().score();
+                protoNode->m_cores = packet.info().cores();
+                protoNode->m_memory = packet.info().memory();
+                updateMaxScore();
+
+                LOGSPN(getLog(), "The client %s has score %.2f, %u cores, %llu MB",
+                       protoNode->fullId().c_str(), protoNode->m_score, protoNode->m_cores, protoNode->m_memory >> 20);
+            }
+
+            protoNode->m_codecs = packet.info().codecs();
+
+            // the projects of the daemon are not changed during the session
+            if (protoNode->m_projects.empty() && packet.info().projects_size())
+            {
+                std::string names;
+
+                for (const auto& project : packet.info().projects())
+                {
+                    protoNode->m_projects.insert(project);
+                    names += (names.empty() ? "" : ", ") + project;
+                }
+
+                LOGSPN(getLog(), "The client %s supports projects: %s", protoNode->fullId().c_str(), names.c_str());
+            }
+
+            // the free cores are filled later in this pass, the nodes go in order of their scores
+        }
+
+        if (packet.has_request())
+        {
+            resendTask(protoNode, packet.request().id());
+        }
+
+        if (packet.blobs_size())
+        {
+            sendBlobs(protoNode, packet);
+        }
+
+        // the daemon has written the input up to the offset, the next chunks may be sent
+        for (const auto& ack : packet.acks())
+        {
+            if (ack.has_hash())
+            {
+                if (auto it = m_blobUploads.find({protoNode, ack.hash()}); it != m_blobUploads.end())
+                {
+                    it->second->ack(ack.offset());
+                }
+            }
+            else if (auto it = m_uploads.find({protoNode, ack.id()}); it != m_uploads.end())
+            {
+                it->second.m_reader->ack(ack.offset());
+            }
+        }
+
+        // the chunks of the output go before its result
+        if (packet.chunks_size())
+        {
+            receiveChunks(protoNode, packet);
+        }
+
+        if (packet.has_result())
+        {
+            applyResultFromSlave(protoNode, *packet.mutable_result());
+        }
+    }
+
+    return true;
+}
+
+su::Net::Node* TcpProtobufServer::newClient(SOCKET socket, const sockaddr_in& addr)
+{
+    auto node = new TcpProtobufNode(Global::tcpMagicNumber, socket, addr, getNextClientId(), getLog());
+
+    m_rampUp[node] = std::chrono::steady_clock::now();
+
+    return node;
+}
+
+void TcpProtobufServer::keepAlive()
+{
+    auto now = std::chrono::steady_clock::now();
+
+    if (now - m_lastPing < pingPeriod)
+    {
+        return;
+    }
+
+    Master::Packet packet;
+
+    packet.mutable_system()->set_ping(true);
+
+    for (auto node : m_clients)
+    {
+        static_cast<TcpProtobufNode*>(node)->send(packet);
+    }
+
+    m_lastPing = now;
+}
+
+bool TcpProtobufServer::sendTasksToSlave(TcpProtobufNode* node)
+{
+    if (m_quarantine.contains(node->m_host))
+    {
+        return true;
+    }
+
+    bool result = true;
+    Master::Packet batch;
+    std::vector<TaskInfo*> deferred;
+    std::vector<ReadAhead::Request> requests;
+
+    while (node->m_freeCores > 0 && deferred.size() < readAheadTasks)
+    {
+        auto task = m_queue.pop(node, isSlow(node));
+        if (!task)
+        {
+            break;
+        }
+
+        // the manifest of the other inputs is made by the read-ahead, the task waits for it in the queue
+        if (task->m_inputs.size() && !isRead(task))
+        {
+            if (!task->m_isRead)
+            {
+                readInput(task, requests);
+            }
+
+            deferred.push_back(task);
+            continue;
+        }
+
+        // the task which can not be sent fails on the node, so it is retried on another one or failed
+        if (!sendTask(node, task, batch))
+        {
+            LOGSPE(getLog(), "Can not send task %u to the client %s", task->m_message.id(), node->fullId().c_str());
+
+            if (assignTask(node, task))
+            {
+                failCopy(node, task->m_message.id());
+            }
+            result = false;
+        }
+    }
+
+    for (auto task : deferred)
+    {
+        m_queue.push(task);
+    }
+
+    m_readAhead.request(requests);
+    sendBatch(node, batch);
+
+    return result;
+}
+
+bool TcpProtobufServer::sendTask(TcpProtobufNode* node, TaskInfo* task, Master::Packet& batch)
+{
+    // the whole input of the old daemon is read by the read-ahead, the task is sent when it is ready
+    if (needsLoad(node, *task, true))
+    {
+        if (!assignTask(node, task))
+        {
+            return false;
+        }
+
+        --node->m_freeCores;
+        loadInput(node, task, true);
+
+        return true;
+    }
+
+    Master::Packet packet;
+
+    if (!loadTask(*task, *packet.mutable_task(), node, true))
+    {
+        return false;
+    }
+
+    if (!assignTask(node, task))
+    {
+        return false;
+    }
+
+    if (packet.task().inputchunks())
+    {
+        startUpload(node, *task);
+    }
+
+    --node->m_freeCores;
+
+    LOGSPN(getLog(), "Send to the client %s task %i", node->fullId().c_str(), task->m_message.id());
+
+    // old daemons can receive only one task per packet
+    if (node->m_protocol >= Global::protocolBatchTasks)
+    {
+        batch.add_tasks()->Swap(packet.mutable_task());
+    }
+    else
+    {
+        node->send(packet);
+    }
+
+    return true;
+}
+
+bool TcpProtobufServer::isSlow(const TcpProtobufNode* node) const
+{
+    return m_isWeighted && node->m_score < m_maxScore * slowNodeRatio;
+}
+
+void TcpProtobufServer::updateMaxScore(const TcpProtobufNode* lost)
+{
+    // the lost node may be in the clients yet, the quarantined one gets no tasks
+    m_maxScore = m_local && !m_quarantine.contains(m_local->node()->m_host) ? m_local->node()->m_score : 0.0f;
+
+    for (auto client : m_clients)
+    {
+        auto node = static_cast<TcpProtobufNode*>(client);
+
+        if (node != lost && !m_quarantine.contains(node->m_host))
+        {
+            m_maxScore = std::max(m_maxScore, node->m_score);
+        }
+    }
+}
+
+bool TcpProtobufServer::assignTask(TcpProtobufNode* node, TaskInfo* task)
+{
+    bool isFirst = !task->m_copies;
+
+    if (!m_queue.assign(node, task))
+    {
+        LOGSPE(getLog(), "The task %u is finished, it is not sent to the client %s", task->m_message.id(), node->fullId().c_str());
+        return false;
+    }
+
+    // the speculative copy keeps the time of the first dispatch
+    if (isFirst)
+    {
+        task->m_dispatchTime = std::chrono::steady_clock::now();
+    }
+
+    if (m_firstDispatch == std::chrono::steady_clock::time_point())
+    {
+        m_firstDispatch = task->m_dispatchTime;
+    }
+    m_peakInFlight = std::max(m_peakInFlight.load(), m_queue.countInFlight());
+
+    return true;
+}
+
+void TcpProtobufServer::sendBatch(TcpProtobufNode* node, Master::Packet& batch)
+{
+    if (batch.tasks_size())
+    {
+        LOGSPI(getLog(), "Send to the client %s batch of %i tasks", node->fullId().c_str(), batch.tasks_size());
+        node->send(batch);
+    }
+
+    auto rampUp = m_rampUp.find(node);
+    if (node->m_freeCores <= 0 && rampUp != m_rampUp.end())
+    {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - rampUp->second);
+
+        LOGSPN(getLog(), "The client %s reached full utilisation in %lli ms", node->fullId().c_str(), elapsed.count());
+        m_rampUp.erase(rampUp);
+    }
+}
+
+bool TcpProtobufServer::isTail() const
+{
+    // the pending and the dependency blocked tasks go before the speculative copies
+    return !m_queue.countPending() && m_generating.empty() && m_blocked.empty();
+}
+
+void TcpProtobufServer::sendSpeculativeTasks()
+{
+    auto now = std::chrono::steady_clock::now();
+
+    if (m_speculation <= 0 || now - m_lastSpeculation < speculationPeriod)
+    {
+        return;
+    }
+
+    m_lastSpeculation = now;
+
+    for (auto client : m_clients)
+    {
+        auto node = static_cast<TcpProtobufNode*>(client);
+        Master::Packet batch;
+
+        if (m_quarantine.contains(node->m_host))
+        {
+            continue;
+        }
+
+        while (node->m_freeCores > 0)
+        {
+            auto task = findStraggler(node, now);
+
+            if (!task || !sendTask(node, task, batch))
+            {
+                break;
+            }
+
+            LOGSPW(getLog(), "The task %u is a straggler, its speculative copy was sent to the client %s",
+                   task->m_message.id(), node->fullId().c_str());
+        }
+
+        sendBatch(node, batch);
+    }
+}
+
+TaskInfo* TcpProtobufServer::findStraggler(TcpProtobufNode* node, std::chrono::steady_clock::time_point now) const
+{
+    uint64_t average = m_countDuration ? m_sumDuration / m_countDuration : 0;
+    TaskInfo* out = nullptr;
+    std::chrono::steady_clock::time_point outDispatch = now;
+
+    for (const auto& [owner, ids] : m_queue.inFlight())
+    {
+        if (owner == node)
+        {
+            continue;
+        }
+
+        for (auto id : ids)
+        {
+            auto task = m_queue.find(id);
+
+            // only one speculative copy per task
+            if (!task || task->m_copies > 1 || task->m_failedHosts.contains(node->m_host) ||
+                !TaskQueue::isCapable(node, task))
+            {
+                continue;
+            }
+
+            // the expected time is for the reference machine
+            auto elapsed = now - task->m_dispatchTime;
+            auto expected = std::chrono::milliseconds(task->m_expected ? task->m_expected : average) / owner->m_score;
+
+            if (elapsed < speculationMinTime || elapsed < expected * m_speculation)
+            {
+                continue;
+            }
+
+            if (task->m_dispatchTime < outDispatch)
+            {
+                out = task;
+                outDispatch = task->m_dispatchTime;
+            }
+        }
+    }
+
+    return out;
+}
+
+bool TcpProtobufServer::loadTask(TaskInfo& task, Master::Task& message, const TcpProtobufNode* node, bool isCacheAllowed)
+{
+    message.CopyFrom(task.m_message);
+
+    uint64_t size = task.m_inputSize;
+    bool isSkipped = isUploadSkipped(node, task, isCacheAllowed);
+    auto head = m_heads.find(message.id());
+
+    // the new daemon gets the input by the chunks after the task, the file is not loaded into the memory.
+    // The input is read by the upload, so there is no disk access here
+    if (node->m_protocol >= Global::protocolStreaming)
+    {
+        message.set_inputchunks(true);
+        message.set_outputchunks(true);
+
+        if (auto codec = FileTransfer::choose(node->m_codecs))
+        {
+            message.set_outputcodec(codec);
+        }
+    }
+    else if (head != m_heads.end() && head->second.m_data.size() == size)
+    {
+        message.set_inputdata(head->second.m_data);
+    }
+    else if (!isSkipped)
+    {
+        LOGSPE(getLog(), "The input '%s' of task %u is not read", task.m_vars.SourceFile.c_str(), message.id());
+        return false;
+    }
+
+    LOGSPI(getLog(), "Loaded '%s' source file, size %llu", task.m_vars.SourceFile.c_str(), size);
+
+    message.set_inputsize(size);
+
+    // the old daemon does not collect the other outputs, the queue does not give it such tasks
+    if (!TaskQueue::isCapable(node, &task))
+    {
+        LOGSPE(getLog(), "The client %s can not run task %u", node->fullId().c_str(), message.id());
+        return false;
+    }
+
+    // the old daemon runs the task, if the other inputs are in its work dir already
+    if (message.inputs_size() && node->m_protocol < Global::protocolManifest)
+    {
+        LOGSPW(getLog(), "The client %s does not receive the other inputs of task %u", node->fullId().c_str(), message.id());
+        message.clear_inputs();
+    }
+
+    if (!message.IsInitialized())
+    {
+        LOGSPE(getLog(), "Initialization of task %u failed", message.id());
+        return false;
+    }
+
+    if (node->m_protocol < Global::protocolInputCache)
+    {
+        return true;
+    }
+
+    // the big input is hashed by its first upload, the task without the hash is always uploaded
+    if (task.m_inputHash.empty())
+    {
+        return true;
+    }
+
+    message.set_inputhash(task.m_inputHash);
+
+    if (isSkipped)
+    {
+        LOGSPI(getLog(), "Skip upload of the task %u input, the client %s may have it", message.id(), node->m_host.c_str());
+
+        ++m_countUploadsSkipped;
+        m_bytesUploadsSkipped += size;
+        message.clear_inputdata();
+        message.clear_inputchunks();
+    }
+
+    return true;
+}
+
+bool TcpProtobufServer::isUploadSkipped(const TcpProtobufNode* node, const TaskInfo& task, bool isCacheAllowed) const
+{
+    if (!isCacheAllowed || node->m_protocol < Global::protocolInputCache || task.m_inputHash.empty())
+    {
+        return false;
+    }
+
+    // the daemon with the blob store gets the hash first, it requests the input only if it has no such content.
+    // The older daemon has the input, if it ran this task in the previous build and the input is not changed
+    return node->m_protocol >= Global::protocolBlobStore ||
+           (task.m_affinity == node->m_host && task.m_affinityHash == Sha256::toHex(task.m_inputHash));
+}
+
+bool TcpProtobufServer::needsLoad(const TcpProtobufNode* node, const TaskInfo& task, bool isCacheAllowed) const
+{
+    // the old daemon gets the whole input in the task, only the small one is in the memory already
+    if (node->m_protocol >= Global::protocolStreaming || isUploadSkipped(node, task, isCacheAllowed))
+    {
+        return false;
+    }
+
+    auto head = m_heads.find(task.m_message.id());
+
+    return head == m_heads.end() || head->second.m_data.size() != task.m_inputSize;
+}
+
+void TcpProtobufServer::loadInput(TcpProtobufNode* node, TaskInfo* task, bool isCacheAllowed)
+{
+    auto& nodes = m_loading[task->m_message.id()];
+
+    // the copies of one task wait for one read
+    if (nodes.empty())
+    {
+        std::vector<ReadAhead::Request> requests(1);
+
+        requests[0].m_id = task->m_message.id();
+        requests[0].m_filename = task->m_vars.SourceFile;
+        requests[0].m_isWhole = true;
+        m_readAhead.request(requests);
+    }
+
+    nodes.push_back({node, isCacheAllowed});
+
+    LOGSPI(getLog(), "The input of task %u is read for the client %s", task->m_message.id(), node->fullId().c_str());
+}
+
+void TcpProtobufServer::takeLoaded(ReadAhead::Result& input)
+{
+    std::vector<std::pair<TcpProtobufNode*, bool>> nodes;
+
+    if (auto it = m_loading.find(input.m_id); it != m_loading.end())
+    {
+        nodes = std::move(it->second);
+        m_loading.erase(it);
+    }
+
+    // the whole input replaces the head, it is dropped when it is sent
+    auto task = m_queue.find(input.m_id);
+
+    dropInput(input.m_id);
+
+    if (task && input.m_isLoaded)
+    {
+        task->m_inputSize = input.m_size;
+        m_heads[input.m_id] = {task->m_build, std::move(input.m_head), input.m_time};
+
+        if (task->m_inputHash.empty())
+        {
+            setInputHash(task, input.m_hash);
+        }
+    }
+    else
+    {
+        m_readAhead.release(input.m_head.size());
+    }
+
+    for (const auto& [node, isCacheAllowed] : nodes)
+    {
+        // the copy is cancelled or its node is lost
+        if (!task || !m_queue.isAssigned(node, input.m_id))
+        {
+            continue;
+        }
+
+        Master::Packet packet;
+
+        if (!input.m_isLoaded || !loadTask(*task, *packet.mutable_task(), node, isCacheAllowed))
+        {
+            LOGSPE(getLog(), "Can not load '%s' source file of task %u for the client %s",
+                   task->m_vars.SourceFile.c_str(), input.m_id, node->fullId().c_str());
+
+            // the daemon has not got the task, its core is free
+            ++node->m_freeCores;
+            failCopy(node, input.m_id);
+            continue;
+        }
+
+        // the resent input was counted as skipped
+        if (!isCacheAllowed)
+        {
+            --m_countUploadsSkipped;
+            m_bytesUploadsSkipped -= packet.task().inputdata().size();
+        }
+
+        LOGSPN(getLog(), "Send to the client %s task %u", node->fullId().c_str(), input.m_id);
+        node->send(packet);
+    }
+
+    dropInput(input.m_id);
+}
+
+uint64_t TcpProtobufServer::startUpload(TcpProtobufNode* node, const TaskInfo& task)
+{
+    auto head = m_heads.find(task.m_message.id());
+    Upload upload;
+
+    // the first copy takes the head, the speculative one and the task dispatched before its read open the file
+    if (head != m_heads.end())
+    {
+        m_readAhead.release(head->second.m_data.size());
+        upload.m_reader = std::make_unique<ChunkReader>(task.m_vars.SourceFile, task.m_inputSize, std::move(head->second.m_data));
+        upload.m_time = head->second.m_time;
+        m_heads.erase(head);
+    }
+    else
+    {
+        upload.m_reader = std::make_unique<ChunkReader>(task.m_vars.SourceFile);
+    }
+
+    auto size = upload.m_reader->size();
+
+    m_uploads[{node, task.m_message.id()}] = std::move(upload);
+
+    return size;
+}
+
+void TcpProtobufServer::sendChunks()
+{
+    Master::Packet packet;
+    auto chunk = packet.add_chunks();
+    std::string raw;
+    std::vector<std::pair<TcpProtobufNode*, uint32_t>> failed;
+
+    // the packet and the buffers are reused, so one chunk is in the memory
+    for (auto it = m_uploads.begin(); it != m_uploads.end(); )
+    {
+        auto [node, id] = it->first;
+        auto& reader = it->second.m_reader;
+
+        chunk->set_id(id);
+        chunk->clear_hash();
+        sendFile(node, *reader, packet, raw);
+
+        if (reader->isOpen() && !reader->isSent())
+        {
+            ++it;
+            continue;
+        }
+
+        // the input bigger than the head is hashed by its upload, the next read of the same file takes this hash
+        auto task = m_queue.find(id);
+
+        if (reader->isOpen() && task && task->m_inputHash.empty())
+        {
+            setInputHash(task, reader->digest());
+
+            if (it->second.m_time != std::filesystem::file_time_type())
+            {
+                m_readAhead.remember({task->m_vars.SourceFile, reader->digest(), reader->size(), it->second.m_time});
+            }
+        }
+
+        if (!reader->isOpen())
+        {
+            LOGSPE(getLog(), "Can not read the input of task %u, the task is cancelled on the client %s",
+                   id, node->fullId().c_str());
+
+            Master::Packet cancel;
+
+            cancel.mutable_cancel()->add_id(id);
+            node->send(cancel);
+            failed.push_back({node, id});
+        }
+
+        it = m_uploads.erase(it);
+    }
+
+    // the copy fails after the uploads are walked, the failed result changes them.
+    // The retries are counted, so the unreadable input does not go between the queue and the node forever
+    for (const auto& [node, id] : failed)
+    {
+        failCopy(node, id);
+    }
+
+    // the inputs of the manifests, the daemon stores them by the hash
+    for (auto it = m_blobUploads.begin(); it != m_blobUploads.end(); )
+    {
+        const auto& [node, hash] = it->first;
+        auto& reader = it->second;
+
+        chunk->set_id(0);
+        chunk->set_hash(hash);
+        sendFile(node, *reader, packet, raw);
+
+        if (reader->isOpen() && !reader->isSent())
+        {
+            ++it;
+            continue;
+        }
+
+        // the daemon runs the tasks without the input, the tool reports the error
+        if (!reader->isOpen())
+        {
+            LOGSPE(getLog(), "Can not read the input %s requested by client %s", Sha256::toHex(hash).c_str(), node->fullId().c_str());
+
+            Master::Packet failed;
+
+            failed.add_blobs()->set_hash(hash);
+            node->send(failed);
+        }
+
+        it = m_blobUploads.erase(it);
+    }
+}
+
+void TcpProtobufServer::sendFile(TcpProtobufNode* node, ChunkReader& reader, Master::Packet& packet, std::string& raw)
+{
+    auto chunk = packet.mutable_chunks(0);
+    auto codec = FileTransfer::choose(node->m_codecs);
+    uint64_t offset = 0;
+    bool isLast = false;
+
+    chunk->clear_last();
+    chunk->clear_digest();
+
+    while (reader.next(offset, raw, isLast))
+    {
+        packChunk(node, codec, raw, *chunk);
+
+        chunk->set_offset(offset);
+        if (isLast)
+        {
+            chunk->set_last(true);
+            chunk->set_digest(reader.digest());
+        }
+
+        node->send(packet);
+    }
+}
+
+void TcpProtobufServer::receiveChunks(TcpProtobufNode* node, Slave::Packet& packet)
+{
+    Master::Packet acks;
+    std::string raw;
+
+    for (auto& chunk : *packet.mutable_chunks())
+    {
+        auto task = m_queue.find(chunk.id());
+
+        // the output of the cancelled copy
+        if (!task || !m_queue.isAssigned(node, chunk.id()))
+        {
+            continue;
+        }
+
+        // the other output has its name in the first chunk, the wrong one is not written and the result fails
+        auto it = m_downloads.find({node, chunk.id(), chunk.file()});
+        if (it == m_downloads.end())
+        {
+            auto filename = chunk.file() ? outputName(task, chunk.name()) : task->m_vars.OutputFile;
+
+            if (filename.empty())
+            {
+                LOGSPE(getLog(), "The client %s sent the wrong output '%s' of task %u", node->fullId().c_str(), chunk.name().c_str(), chunk.id());
+            }
+
+            it = m_downloads.emplace(std::make_tuple(node, chunk.id(), chunk.file()), filename.size() ? m_writer.open(filename) : 0).first;
+        }
+
+        // the failed chunk is acknowledged too, the daemon finishes the transfer and the result fails
+        auto ack = acks.add_acks();
+
+        ack->set_id(chunk.id());
+        ack->set_offset(chunk.offset() + (chunk.codec() ? chunk.rawsize() : chunk.data().size()));
+
+        if (chunk.file())
+        {
+            ack->set_file(chunk.file());
+        }
+
+        if (!unpackChunk(node, chunk, raw))
+        {
+            LOGSPE(getLog(), "Can not decompress the output of task %u from client %s", chunk.id(), node->fullId().c_str());
+        }
+
+        // the writer checks the order and the digest, the failure is reported by the commit
+        m_writer.write(it->second, chunk.offset(), chunk.codec() ? std::move(raw) : std::move(*chunk.mutable_data()));
+
+        if (chunk.last())
+        {
+            m_writer.finish(it->second, chunk.digest());
+        }
+    }
+
+    if (acks.acks_size())
+    {
+        node->send(acks);
+    }
+}
+
+void TcpProtobufServer::packChunk(TcpProtobufNode* node, FileTransfer::Codec codec, std::string& raw, Transfer::Chunk& chunk)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // the incompressible data goes as is, the buffers are swapped
+    if (FileTransfer::pack(codec, raw, *chunk.mutable_data()) == FileTransfer::Raw)
+    {
+        chunk.mutable_data()->swap(raw);
+        chunk.clear_codec();
+        chunk.clear_rawsize();
+    }
+    else
+    {
+        chunk.set_codec(codec);
+        chunk.set_rawsize(static_cast<uint32_t>(raw.size()));
+    }
+
+    if (codec != FileTransfer::Raw)
+    {
+        node->m_bytesRaw += chunk.has_rawsize() ? chunk.rawsize() : chunk.data().size();
+        node->m_bytesWire += chunk.data().size();
+        node->m_codecTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+bool TcpProtobufServer::unpackChunk(TcpProtobufNode* node, const Transfer::Chunk& chunk, std::string& raw)
+{
+    if (!chunk.codec())
+    {
+        node->m_bytesRaw += node->m_codecs ? chunk.data().size() : 0;
+        node->m_bytesWire += node->m_codecs ? chunk.data().size() : 0;
+        return true;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    bool result = FileTransfer::unpack(chunk.codec(), chunk.data(), chunk.rawsize(), raw);
+
+    node->m_bytesRaw += chunk.rawsize();
+    node->m_bytesWire += chunk.data().size();
+    node->m_codecTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    return result;
+}
+
+void TcpProtobufServer::dropTransfers(TcpProtobufNode* node)
+{
+    auto isNode = [node](const auto& item) { return item.first.first == node; };
+
+    std::erase_if(m_uploads, isNode);
+    std::erase_if(m_blobUploads, isNode);
+
+    for (auto& [hash, nodes] : m_blobWaiting)
+    {
+        std::erase(nodes, node);
+    }
+
+    for (auto& [id, nodes] : m_loading)
+    {
+        std::erase_if(nodes, [node](const auto& item) { return item.first == node; });
+    }
 
-TcpProtobufServer::TcpProtobufServer(std::vector<TaskInfo>& taskInfo, const std::string& ip, uint16_t port,
-                                     uint32_t maxClients, su::Log* plog) :
-    su::Net::TcpServer(ip, port, maxClients, plog),
-    m_tasks(taskInfo)
+    for (auto it = m_downloads.lower_bound({node, 0, 0}); it != m_downloads.end() && std::get<0>(it->first) == node; )
+    {
+        m_writer.drop(it->second);
+        it = m_downloads.erase(it);
+    }
+}
+
+void TcpProtobufServer::dropDownload(TcpProtobufNode* node, uint32_t id)
 {
-    m_immediatelyCloseClients = true;
+    for (auto key : takeDownloads(node, id))
+    {
+        m_writer.drop(key);
+    }
 }
 
-void TcpProtobufServer::closeAllClients()
+std::vector<uint64_t> TcpProtobufServer::takeDownloads(TcpProtobufNode* node, uint32_t id)
 {
-    Master::Packet packet;
+    std::vector<uint64_t> out;
 
-    packet.mutable_system()->set_close(true);
+    for (auto it = m_downloads.lower_bound({node, id, 0}); it != m_downloads.end() && it->first < std::make_tuple(node, id + 1, 0u); )
+    {
+        out.push_back(it->second);
+        it = m_downloads.erase(it);
+    }
 
-    std::lock_guard<std::mutex> guard(getMutex());
+    return out;
+}
 
-    for (auto node: m_clients)
+std::string TcpProtobufServer::outputName(const TaskInfo* task, const std::string& name) const
+{
+    // the daemon must not write out of the project dir
+    if (!name.starts_with("$(pdir)") || name.find("..") != std::string::npos)
     {
-        static_cast<TcpProtobufNode*>(node)->send(packet);
+        return "";
+    }
+
+    // and it writes only the declared outputs of the task
+    const auto& outputs = task->m_message.outputs();
+
+    if (std::none_of(outputs.begin(), outputs.end(), [&name](const std::string& output) { return Wildcard::isMatch(name, output); }))
+    {
+        return "";
     }
+
+    return su::String_replace(name, "$(pdir)", task->m_vars.PDir, true);
 }
 
-void TcpProtobufServer::doWork()
+bool TcpProtobufServer::hasDeclaredOutputs(TcpProtobufNode* node, const TaskInfo* task, const Slave::Result& packet)
 {
-    su::Net::TcpServer::doWork();
+    bool result = true;
 
-    for (auto node: m_clients)
+    // the mask may match no files, the output with the explicit name must be received
+    for (const auto& output : task->m_message.outputs())
+    {
+        if (Wildcard::isMask(output))
+        {
+            continue;
+        }
+
+        // the local task writes its outputs in place
+        auto name = su::String_tolower(output);
+        std::error_code ec;
+        bool isReceived = isLocal(node) ? std::filesystem::is_regular_file(outputName(task, output), ec) :
+            std::any_of(packet.outputfiles().begin(), packet.outputfiles().end(),
+                        [&name](const std::string& file) { return su::String_tolower(file) == name; });
+
+        if (!isReceived)
+        {
+            LOGSPE(getLog(), "The client %s did not send the declared output '%s' of task %u",
+                   node->fullId().c_str(), output.c_str(), task->m_message.id());
+            result = false;
+        }
+    }
+
+    return result;
+}
+
+bool TcpProtobufServer::resendTask(TcpProtobufNode* node, uint32_t id)
+{
+    auto task = m_queue.find(id);
+
+    if (!task || !m_queue.isAssigned(node, id))
+    {
+        LOGSPE(getLog(), "The client %s requested the input of wrong task %u", node->fullId().c_str(), id);
+        return false;
+    }
+
+    if (needsLoad(node, *task, false))
+    {
+        loadInput(node, task, false);
+        return true;
+    }
+
+    Master::Packet packet;
+
+    if (!loadTask(*task, *packet.mutable_task(), node, false))
     {
-        sendTasksToSlave(static_cast<TcpProtobufNode*>(node));
+        return false;
     }
 
+    // it was counted as skipped, but it is uploaded now
+    --m_countUploadsSkipped;
+    m_bytesUploadsSkipped -= packet.task().inputchunks() ? startUpload(node, *task) : packet.task().inputdata().size();
+
+    LOGSPI(getLog(), "Resend task %u with the input to the client %s", id, node->fullId().c_str());
+
+    return node->send(packet);
 }
 
-void TcpProtobufServer::onClientDisconnected(su::Net::Node* node)
+void TcpProtobufServer::sendBlobs(TcpProtobufNode* node, const Slave::Packet& request)
 {
-    auto protoNode = static_cast<TcpProtobufNode*>(node);
+    std::vector<ReadAhead::Request> requests;
+    Master::Packet failed;
 
-    for (auto& task: m_tasks)
+    // the daemon requests every content once. The file is read by the read-ahead and goes by the chunks
+    // as the input of a task, the content requested by several daemons is read once
+    for (const auto& hash : request.blobs())
     {
-        std::lock_guard<std::mutex> guard(task.m_mutex);
+        auto it = m_blobFiles.find(hash);
 
-        if (task.m_node != protoNode)
+        if (it == m_blobFiles.end())
         {
+            LOGSPE(getLog(), "The input %s requested by client %s is unknown", Sha256::toHex(hash).c_str(), node->fullId().c_str());
+            failed.add_blobs()->set_hash(hash);
             continue;
         }
 
-        task.m_node = nullptr;
+        auto& nodes = m_blobWaiting[hash];
 
-        LOGSPW(getLog(), "Do free the %i task because the client %s was disconnect",
-               task.m_message.id(), node->fullId().c_str());
+        if (nodes.empty())
+        {
+            requests.push_back({0, it->second, {}, hash});
+        }
+
+        nodes.push_back(node);
+    }
+
+    if (failed.blobs_size())
+    {
+        node->send(failed);
     }
+
+    m_readAhead.request(requests);
 }
 
-bool TcpProtobufServer::onRecvFromNode(su::Net::Node* node)
+void TcpProtobufServer::takeBlob(ReadAhead::Result& input)
 {
-    auto protoNode = static_cast<TcpProtobufNode*>(node);
+    std::vector<TcpProtobufNode*> nodes;
 
-    while (protoNode->countRecvPackets())
+    if (auto it = m_blobWaiting.find(input.m_blob); it != m_blobWaiting.end())
     {
-        auto data = protoNode->extractRecvPacket();
-
-        Slave::Packet packet;
+        nodes = std::move(it->second);
+        m_blobWaiting.erase(it);
+    }
 
-        packet.ParseFromArray(data.raw.data(), (int)data.raw.size());
+    // the file is changed after its task was read, the daemon does not get the other content
+    auto file = m_blobFiles.find(input.m_blob);
+    bool isSame = input.m_isLoaded && input.m_hash == input.m_blob && file != m_blobFiles.end();
 
-        if (!packet.IsInitialized())
+    for (auto node : nodes)
+    {
+        if (!isSame)
         {
-            LOGSPE(getLog(), "Can not parse the slave protobuf packet");
-            return false;
+            LOGSPE(getLog(), "Can not read the input %s requested by client %s", Sha256::toHex(input.m_blob).c_str(), node->fullId().c_str());
+
+            Master::Packet failed;
+
+            failed.add_blobs()->set_hash(input.m_blob);
+            node->send(failed);
+            continue;
         }
 
-        if (packet.has_info())
+        LOGSPI(getLog(), "Send the input '%s' to client %s", file->second.c_str(), node->fullId().c_str());
+
+        auto head = input.m_head;
+
+        m_blobUploads[{node, input.m_blob}] = std::make_unique<ChunkReader>(file->second, input.m_size, std::move(head));
+    }
+
+    m_readAhead.release(input.m_head.size());
+}
+
+bool TcpProtobufServer::applyResultFromSlave(TcpProtobufNode* node, Slave::Result& packet, bool isSent)
+{
+    auto task = m_queue.unassign(node, packet.id());
+    auto downloads = takeDownloads(node, packet.id()); // the output file is the first
+
+    m_uploads.erase({node, packet.id()});
+
+    if (!task)
+    {
+        for (auto download : downloads)
         {
-            protoNode->m_freeCores = packet.info().task_count();
-            LOGSPN(getLog(), "The client %s sent %i free cores",
-                   protoNode->fullId().c_str(), protoNode->m_freeCores);
+            m_writer.drop(download);
+        }
 
-            sendTasksToSlave(protoNode);
+        if (m_queue.find(packet.id()))
+        {
+            LOGSPI(getLog(), "Ignore the result of the cancelled task %i from client %s", packet.id(), node->fullId().c_str());
+            return true;
         }
 
-        if (packet.has_result())
+        LOGSPE(getLog(), "Received wrong packet with id %i from client %s", packet.id(), node->fullId().c_str());
+        return false;
+    }
+
+    auto result = static_cast<su::Process::ExitCodeResult>(packet.process_code());
+    bool isSuccess = result == su::Process::ExitCodeResult::Exited && !packet.exit_code();
+
+    // the tool exited well, but the task without its declared output is failed
+    if (isSuccess && !hasDeclaredOutputs(node, task, packet))
+    {
+        packet.set_exit_code(-1);
+        isSuccess = false;
+    }
+
+    // the failed local task leaves its temporary output
+    if (!isSuccess && isLocal(node))
+    {
+        LocalWorker::removeOutput(packet.outputfile());
+    }
+
+    for (auto download : isSuccess ? std::vector<uint64_t>() : downloads)
+    {
+        m_writer.drop(download);
+    }
+
+    // the first successful copy wins
+    if (!isSuccess && task->m_copies)
+    {
+        LOGSPW(getLog(), "The task %i failed on client %s, waiting for its speculative copy",
+               packet.id(), node->fullId().c_str());
+        return true;
+    }
+
+    // the copy not sent by the console is not the fault of the host
+    bool isHostFault = isSent && (result == su::Process::ExitCodeResult::NotStarted ||
+                                  (result == su::Process::ExitCodeResult::Exited && isCrashCode(packet.exit_code())));
+
+    if (!isSuccess && retryTask(node, task, result, packet.exit_code(), isHostFault))
+    {
+        return true;
+    }
+
+    if (isSuccess)
+    {
+        m_hostFaults.erase(node->m_host);
+    }
+
+    task->m_exitCode = packet.exit_code();
+    task->m_result = result;
+    task->m_doneIp = isLocal(node) ? node->m_host : node->fullId();
+    task->m_doneHost = node->m_host;
+
+    m_lastResult = std::chrono::steady_clock::now();
+
+    // the daemon measures the process only, without the transfer and the prefetch waiting.
+    // The duration is normalised to the reference machine by the score of the node
+    uint32_t duration = packet.has_duration() ? packet.duration() :
+        static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(m_lastResult - task->m_dispatchTime).count());
+
+    task->m_duration = static_cast<uint32_t>(duration * node->m_score);
+
+    if (isSuccess)
+    {
+        m_sumDuration += task->m_duration;
+        ++m_countDuration;
+    }
+
+    LOGSPI(getLog(), "Received result packet with id %i from client %s", packet.id(), node->fullId().c_str());
+
+    // the winner copy renames its temporary files, the files of the loser are dropped.
+    // The task is finished when its outputs are written, the commit of the not received output fails
+    if (isSuccess && packet.outputchunks())
+    {
+        downloads.resize(std::max<size_t>(downloads.size(), 1 + packet.outputfiles_size()));
+
+        for (auto download : downloads)
         {
-            applyResultFromSlave(protoNode, packet.result());
+            m_writer.commit(download, packet.id());
         }
+
+        m_writing[packet.id()] = {task, downloads.size()};
+    }
+    else if (isSuccess && isLocal(node) && packet.has_outputfile())
+    {
+        m_writer.move(packet.id(), packet.outputfile(), task->m_vars.OutputFile);
+        m_writing[packet.id()] = {task, 1};
+    }
+    else if (isSuccess && packet.has_outputdata())
+    {
+        m_writer.save(packet.id(), task->m_vars.OutputFile, std::move(*packet.mutable_outputdata()));
+        m_writing[packet.id()] = {task, 1};
+    }
+    else
+    {
+        finishTask(task);
+    }
+
+    for (auto loser : m_queue.unassignAll(packet.id()))
+    {
+        cancelCopy(loser, packet.id());
+
+        LOGSPI(getLog(), "Cancel the speculative copy of task %i on client %s", packet.id(), loser->fullId().c_str());
     }
 
     return true;
 }
 
-su::Net::Node* TcpProtobufServer::newClient(SOCKET socket, const sockaddr_in& addr)
+void TcpProtobufServer::failCopy(TcpProtobufNode* node, uint32_t id)
 {
-    return new TcpProtobufNode(Global::tcpMagicNumber, socket, addr, getNextClientId(), getLog());
+    Slave::Result result;
+
+    // the copy fails as the task not started on the node, it is retried or the task is failed
+    result.set_id(id);
+    result.set_exit_code(-1);
+    result.set_process_code(static_cast<int32_t>(su::Process::ExitCodeResult::NotStarted));
+
+    applyResultFromSlave(node, result, false);
 }
 
-bool TcpProtobufServer::sendTasksToSlave(TcpProtobufNode* node)
+void TcpProtobufServer::cancelCopy(TcpProtobufNode* node, uint32_t id)
 {
-    if (node->m_freeCores <= 0)
+    if (isLocal(node))
     {
-        return true;
+        m_local->cancel(id);
+        return;
     }
 
-    for (auto& task: m_tasks)
+    Master::Packet cancel;
+
+    cancel.mutable_cancel()->add_id(id);
+    node->send(cancel);
+    m_uploads.erase({node, id});
+    dropDownload(node, id);
+}
+
+void TcpProtobufServer::takeOutputs()
+{
+    for (const auto& output : m_writer.takeReady())
     {
-        std::lock_guard<std::mutex> guard(task.m_mutex);
+        auto it = m_writing.find(output.m_id);
 
-        if (task.m_node || task.m_result != su::Process::ExitCodeResult::NoInit)
+        // the build is released
+        if (it == m_writing.end())
         {
             continue;
         }
 
-        Master::Packet packet;
-
-        packet.mutable_task()->CopyFrom(task.m_message);
+        auto task = it->second.m_task;
+        auto& filename = output.m_filename.size() ? output.m_filename : task->m_vars.OutputFile;
 
-        if (su::fs::load(task.m_vars.SourceFile, *packet.mutable_task()->mutable_inputdata()) != su::fs::OK)
+        if (it->second.m_isRestored)
         {
-            LOGSPE(getLog(), "Can not load '%s' source file", task.m_vars.SourceFile.c_str());
+            m_writing.erase(it);
+            takeRestored(task, output.m_isSaved);
+            continue;
         }
 
-        LOGSPI(getLog(), "Loaded '%s' source file, size %u",
-               task.m_vars.SourceFile.c_str(), packet.mutable_task()->inputdata().size());
+        if (!output.m_isSaved)
+        {
+            LOGSPE(getLog(), "Can not save output file to '%s'", filename.c_str());
+            task->m_exitCode = -1;
+        }
+        else if (output.m_isUnchanged)
+        {
+            LOGSPI(getLog(), "The output file '%s' is not changed", filename.c_str());
+            ++m_countOutputsUnchanged;
+        }
 
-        if (!packet.mutable_task()->IsInitialized())
+        // the task is finished with its last output
+        if (--it->second.m_count)
         {
-            LOGSPE(getLog(), "Initialization of task %u failed", packet.mutable_task()->id());
-            return false;
+            continue;
         }
 
-        task.m_node = node;
+        m_writing.erase(it);
+        finishTask(task);
+    }
+}
 
-        LOGSPN(getLog(), "Send to the client %s task %i", node->fullId().c_str(), packet.mutable_task()->id());
-        node->send(packet);
+void TcpProtobufServer::finishTask(TaskInfo* task)
+{
+    bool isDone = task->m_result == su::Process::ExitCodeResult::Exited && !task->m_exitCode;
 
-        --node->m_freeCores;
-        return true;
+    if (!task->moveTo(isDone ? TaskState::Done : TaskState::Failed))
+    {
+        LOGSPE(getLog(), "The task %u is already finished", task->m_message.id());
+        return;
+    }
+
+    task->m_finishTime = std::chrono::steady_clock::now();
+    complete(task);
+    releaseDependents(task);
+}
+
+bool TcpProtobufServer::restoreFromCache(TaskInfo* task)
+{
+    // the key is made with the input hash, the task with the other outputs is not cached
+    if (!m_actionCache || task->m_actionKey.empty() || task->m_message.outputs_size())
+    {
+        return false;
     }
 
+    auto entry = m_actionCache->find(task->m_actionKey);
+
+    // the queued task is taken out, so it is not dispatched while its output is restored
+    if (entry.empty() || !m_queue.cancel(task))
+    {
+        return false;
+    }
+
+    m_writer.copy(task->m_message.id(), entry, task->m_vars.OutputFile);
+    m_writing[task->m_message.id()] = {task, 1, true};
+
     return true;
 }
 
-bool TcpProtobufServer::applyResultFromSlave(TcpProtobufNode* node, const Slave::Result& packet)
+void TcpProtobufServer::takeRestored(TaskInfo* task, bool isRestored)
 {
-    for (auto& task: m_tasks)
+    m_actionCache->restored(isRestored);
+
+    // the task runs as usual
+    if (!isRestored)
     {
-        std::lock_guard<std::mutex> guard(task.m_mutex);
+        LOGSPW(getLog(), "Can not restore '%s' from the action cache", task->m_vars.OutputFile.c_str());
+        m_queue.push(task);
+        return;
+    }
+
+    LOGSPI(getLog(), "The output of task %u is restored from the action cache", task->m_message.id());
 
-        if (task.m_node != node || packet.id() != task.m_message.id())
+    task->m_exitCode = 0;
+    task->m_result = su::Process::ExitCodeResult::Exited;
+    task->m_doneIp = "cached";
+    task->m_isCached = true;
+    task->m_dispatchTime = std::chrono::steady_clock::now();
+
+    finishTask(task);
+}
+
+void TcpProtobufServer::complete(TaskInfo* task)
+{
+    dropInput(task->m_message.id());
+    m_completions.push({task->m_message.id(), task->m_build, task->m_doneIp, task->m_result, task->m_exitCode});
+}
+
+void TcpProtobufServer::releaseDependents(TaskInfo* task)
+{
+    std::vector<TaskInfo*> failed;
+
+    for (auto dependent : task->m_dependents)
+    {
+        // the dependent is skipped already by its other failed dependency
+        if (dependent->isFinished())
         {
             continue;
         }
 
-        task.m_exitCode = packet.exit_code();
-        task.m_result = static_cast<su::Process::ExitCodeResult>(packet.process_code());
-        task.m_doneIp = task.m_node->fullId();
-        task.m_node = nullptr;
-
-        if (!task.m_exitCode && task.m_result == su::Process::ExitCodeResult::Exited && packet.has_outputdata())
+        if (task->m_state == TaskState::Done)
         {
-            task.m_exitCode = su::fs::save(task.m_vars.OutputFile, packet.outputdata());
-            if (task.m_exitCode != su::fs::OK)
+            if (!--dependent->m_waiting)
             {
-                LOGSPE(getLog(), "Can not save output file to '%s', size %u",
-                       task.m_vars.OutputFile.c_str(),
-                        packet.outputfile().size());
+                unblock(dependent);
+                LOGSPI(getLog(), "The dependencies of task %u are done, it is queued", dependent->m_message.id());
+
+                // the cached dependent is done, when its input is read, so it releases its own dependents then
+                m_queue.push(dependent);
             }
+            continue;
+        }
+
+        failed.push_back(dependent);
+    }
+
+    // the failure goes through the whole subgraph, without recursion
+    while (failed.size())
+    {
+        auto dependent = failed.back();
+        failed.pop_back();
+
+        dependent->m_result = su::Process::ExitCodeResult::NotStarted;
+        dependent->m_doneIp = "skipped";
+
+        if (!dependent->moveTo(TaskState::Failed))
+        {
+            continue;
         }
 
-        LOGSPI(getLog(), "Received result packet with id %i from client %s", packet.id(), node->fullId().c_str());
+        unblock(dependent);
+
+        LOGSPW(getLog(), "The task %u is skipped, its dependency failed", dependent->m_message.id());
+
+        complete(dependent);
+        failed.insert(failed.end(), dependent->m_dependents.begin(), dependent->m_dependents.end());
+    }
+}
+
+void TcpProtobufServer::unblock(const TaskInfo* task)
+{
+    auto it = m_blocked.find(task->m_build);
+
+    if (it != m_blocked.end() && !--it->second)
+    {
+        m_blocked.erase(it);
+    }
+}
+
+bool TcpProtobufServer::retryTask(TcpProtobufNode* node, TaskInfo* task, su::Process::ExitCodeResult result, int32_t exitCode,
+                                  bool isHostFault)
+{
+    if (isHostFault && m_quarantineLimit && ++m_hostFaults[node->m_host] >= m_quarantineLimit)
+    {
+        quarantine(node);
+    }
+
+    task->m_failedHosts.insert(node->m_host);
+
+    if (task->m_attempts >= m_retries || !hasOtherHost(task))
+    {
+        return false;
+    }
+
+    if (!m_queue.push(task))
+    {
+        return false;
+    }
+
+    ++task->m_attempts;
+
+    LOGSPW(getLog(), "The task %u failed on client %s (status %i, exit code %i). Retry %u of %u on another client",
+           task->m_message.id(), node->fullId().c_str(), static_cast<int>(result), exitCode, task->m_attempts, m_retries);
 
+    return true;
+}
+
+bool TcpProtobufServer::hasOtherHost(const TaskInfo* task) const
+{
+    if (m_local && !m_quarantine.contains(m_local->node()->m_host) &&
+        !task->m_failedHosts.contains(m_local->node()->m_host) && LocalWorker::isRedirected(*task))
+    {
         return true;
-   }
+    }
+
+    for (auto client : m_clients)
+    {
+        auto node = static_cast<TcpProtobufNode*>(client);
+
+        if (!m_quarantine.contains(node->m_host) && !task->m_failedHosts.contains(node->m_host) &&
+            TaskQueue::isCapable(node, task))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void TcpProtobufServer::failStranded()
+{
+    m_isHostLost = false;
+
+    // the retried task waits for a host it has not failed on. The new daemon may connect later,
+    // but the task without such a host among the connected ones would hang the build
+    for (auto task : m_queue.pending())
+    {
+        if (task->m_failedHosts.empty() || hasOtherHost(task) || !m_queue.cancel(task))
+        {
+            continue;
+        }
+
+        LOGSPE(getLog(), "The task %u failed on all clients which can run it, it is not retried", task->m_message.id());
+
+        task->m_result = su::Process::ExitCodeResult::NotStarted;
+        task->m_doneIp = "no host";
+        finishTask(task);
+    }
+}
+
+void TcpProtobufServer::quarantine(TcpProtobufNode* node)
+{
+    if (!m_quarantine.insert(node->m_host).second)
+    {
+        return;
+    }
+
+    m_isHostLost = true;
+    updateMaxScore();
+
+    LOGSPE(getLog(), "The host %s failed %u times in a row and is quarantined for the rest of the session",
+           node->m_host.c_str(), m_hostFaults[node->m_host]);
+
+    if (isLocal(node))
+    {
+        return;
+    }
 
-    LOGSPE(getLog(), "Received wrong packet with id %i from client %s", packet.id(), node->fullId().c_str());
+    Master::Packet packet;
 
-   return false;
+    packet.mutable_system()->set_close(true);
+    node->send(packet);
 }
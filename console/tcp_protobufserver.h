@@ -1,19 +1,61 @@
 #pragma once
 
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "net/tcp_server.h"
 
+#include "action_cache.h"
+#include "completion_queue.h"
 #include "console.h"
+#include "file_transfer.h"
+#include "local_worker.h"
+#include "output_writer.h"
+#include "read_ahead.h"
+#include "task_queue.h"
 
 class TcpProtobufServer : public su::Net::TcpServer
 {
 public:
-    TcpProtobufServer(std::vector<TaskInfo>& taskInfo, const std::string& ip, uint16_t port,
-                      uint32_t maxClients, su::Log* plog);
+    TcpProtobufServer(const std::string& ip, uint16_t port, uint32_t maxClients, su::Log* plog);
     virtual ~TcpProtobufServer() = default;
 
+    // thread safe, the task generator adds the tasks while the server is working.
+    // The task must not be moved until the server is closed
+    void submit(TaskInfo* task);
+
+    // thread safe, the generator has submitted all tasks of the build
+    void setGenerated(uint32_t build);
+
+    // the tasks of the released build may be deleted, when it is returned by takeReleased
+    void release(uint32_t build);
+    std::vector<uint32_t> takeReleased();
+
+    // the coordinator pings the idle daemons, so they keep the connection between the builds
+    void setKeepAlive(bool isKeepAlive) { m_isKeepAlive = isKeepAlive; }
+
     void closeAllClients();
+    void setSpeculation(double factor) { m_speculation = factor; }
+    void setRetry(uint32_t retries, uint32_t quarantine) { m_retries = retries; m_quarantineLimit = quarantine; }
+    void setLocalSlots(uint32_t slots);
+    void setWeighted(bool isWeighted) { m_isWeighted = isWeighted; }
+    void setActionCache(ActionCache* cache) { m_actionCache = cache; }
+    bool hasLocalSlots() const { return m_local != nullptr; }
+    CompletionQueue& completions() { return m_completions; }
+
+    const std::unordered_set<std::string>& quarantinedHosts() const { return m_quarantine; }
+
+    size_t peakInFlight() const { return m_peakInFlight; }
+    uint32_t makespan() const;
+    uint64_t countUploadsSkipped() const { return m_countUploadsSkipped; }
+    uint64_t bytesUploadsSkipped() const { return m_bytesUploadsSkipped; }
+    uint64_t countOutputsUnchanged() const { return m_countOutputsUnchanged; }
 
 protected:
     // ThreadClass
@@ -27,9 +69,140 @@ protected:
     virtual su::Net::Node* newClient(SOCKET socket, const sockaddr_in& addr) override;
 
 private:
+    void takeSubmitted();
+    void readAhead();
+    void readInput(TaskInfo* task, std::vector<ReadAhead::Request>& requests);
+    bool isRead(const TaskInfo* task) const { return task->m_isRead && !m_reading.contains(task->m_message.id()); }
+    void takeInputs();
+    void setInputHash(TaskInfo* task, const std::string& hash);
+    void addManifest(TaskInfo* task, const std::vector<ReadAhead::File>& inputs);
+    void dropInput(uint32_t id);
+    void dropInputs(uint32_t build);
+    void takeOutputs();
+    void keepAlive();
     bool sendTasksToSlave(TcpProtobufNode* node);
-    bool applyResultFromSlave(TcpProtobufNode* node, const Slave::Result& packet);
+    bool sendTask(TcpProtobufNode* node, TaskInfo* task, Master::Packet& batch);
+    bool assignTask(TcpProtobufNode* node, TaskInfo* task);
+    void doLocalWork();
+    bool isLocal(const TcpProtobufNode* node) const { return m_local && node == m_local->node(); }
+    bool isSlow(const TcpProtobufNode* node) const;
+    void updateMaxScore(const TcpProtobufNode* lost = nullptr);
+    void sendBatch(TcpProtobufNode* node, Master::Packet& batch);
+    bool isTail() const;
+    void sendSpeculativeTasks();
+    TaskInfo* findStraggler(TcpProtobufNode* node, std::chrono::steady_clock::time_point now) const;
+    bool loadTask(TaskInfo& task, Master::Task& message, const TcpProtobufNode* node, bool isCacheAllowed);
+    bool isUploadSkipped(const TcpProtobufNode* node, const TaskInfo& task, bool isCacheAllowed) const;
+    bool needsLoad(const TcpProtobufNode* node, const TaskInfo& task, bool isCacheAllowed) const;
+    void loadInput(TcpProtobufNode* node, TaskInfo* task, bool isCacheAllowed);
+    void takeLoaded(ReadAhead::Result& input);
+    uint64_t startUpload(TcpProtobufNode* node, const TaskInfo& task);
+    void sendChunks();
+    void sendFile(TcpProtobufNode* node, ChunkReader& reader, Master::Packet& packet, std::string& raw);
+    void receiveChunks(TcpProtobufNode* node, Slave::Packet& packet);
+    void packChunk(TcpProtobufNode* node, FileTransfer::Codec codec, std::string& raw, Transfer::Chunk& chunk);
+    bool unpackChunk(TcpProtobufNode* node, const Transfer::Chunk& chunk, std::string& raw);
+    void dropTransfers(TcpProtobufNode* node);
+    void dropDownload(TcpProtobufNode* node, uint32_t id);
+    std::vector<uint64_t> takeDownloads(TcpProtobufNode* node, uint32_t id);
+    std::string outputName(const TaskInfo* task, const std::string& name) const;
+    bool hasDeclaredOutputs(TcpProtobufNode* node, const TaskInfo* task, const Slave::Result& packet);
+    bool resendTask(TcpProtobufNode* node, uint32_t id);
+    void sendBlobs(TcpProtobufNode* node, const Slave::Packet& request);
+    void takeBlob(ReadAhead::Result& input);
+    bool applyResultFromSlave(TcpProtobufNode* node, Slave::Result& packet, bool isSent = true);
+    void failCopy(TcpProtobufNode* node, uint32_t id);
+    bool retryTask(TcpProtobufNode* node, TaskInfo* task, su::Process::ExitCodeResult result, int32_t exitCode, bool isHostFault);
+    bool hasOtherHost(const TaskInfo* task) const;
+    void failStranded();
+    // the task is taken out of the queue, while its output is copied from the cache
+    bool restoreFromCache(TaskInfo* task);
+    void takeRestored(TaskInfo* task, bool isRestored);
+    void cancelCopy(TcpProtobufNode* node, uint32_t id);
+    void finishTask(TaskInfo* task);
+    void complete(TaskInfo* task);
+    void releaseDependents(TaskInfo* task);
+    void unblock(const TaskInfo* task);
+    void quarantine(TcpProtobufNode* node);
 
 private:
-    std::vector<TaskInfo>& m_tasks;
+    // the first chunk of the read input, it is sent without the disk access. It may be empty
+    struct Head
+    {
+        uint32_t m_build = 0;
+        std::string m_data = "";
+        std::filesystem::file_time_type m_time;
+    };
+
+    // the input being sent, the hash made by the upload is remembered by the time of the read file
+    struct Upload
+    {
+        std::unique_ptr<ChunkReader> m_reader;
+        std::filesystem::file_time_type m_time;
+    };
+
+    // the finished task, its outputs are being written
+    struct Writing
+    {
+        TaskInfo* m_task = nullptr;
+        size_t m_count = 0;
+        bool m_isRestored = false; // the output of the action cache, the task is not run
+    };
+
+    TaskQueue m_queue;
+    CompletionQueue m_completions;
+    ReadAhead m_readAhead;
+    std::unordered_map<uint32_t, TaskInfo*> m_reading; // the queued tasks, their inputs are being read
+    std::unordered_map<uint32_t, Head> m_heads;
+    std::unordered_map<std::string, std::string> m_blobFiles; // the hash of the manifest input and its file
+    std::unordered_map<std::string, std::vector<TcpProtobufNode*>> m_blobWaiting; // the requested inputs being read
+    std::unordered_map<uint32_t, std::vector<std::pair<TcpProtobufNode*, bool>>> m_loading; // the old daemons wait for the whole inputs
+    OutputWriter m_writer;
+    std::unordered_map<uint32_t, Writing> m_writing;
+    std::mutex m_submitMutex;
+    std::vector<TaskInfo*> m_submitted;
+    std::vector<uint32_t> m_releasing;
+    std::vector<uint32_t> m_released;
+    std::vector<uint32_t> m_generated;
+    std::unordered_set<uint32_t> m_generating; // the builds, which may submit more tasks
+    std::unordered_map<uint32_t, size_t> m_blocked; // the tasks waiting for their dependencies by the build
+
+    bool m_isKeepAlive = false;
+    std::chrono::steady_clock::time_point m_lastPing;
+    std::unique_ptr<LocalWorker> m_local;
+    ActionCache* m_actionCache = nullptr;
+
+    // the fast nodes get the longest tasks, the slow ones get the shortest
+    bool m_isWeighted = false;
+    float m_maxScore = 1.0f;
+    std::unordered_map<TcpProtobufNode*, std::chrono::steady_clock::time_point> m_rampUp;
+
+    std::atomic<size_t> m_peakInFlight = 0;
+    std::chrono::steady_clock::time_point m_firstDispatch;
+    std::chrono::steady_clock::time_point m_lastResult;
+
+    // tail mode, the straggler is running longer than m_speculation * expected time.
+    // It starts when all tasks of all builds are generated and dispatched
+    double m_speculation = 0;
+    std::chrono::steady_clock::time_point m_lastSpeculation;
+    uint64_t m_sumDuration = 0;
+    uint64_t m_countDuration = 0;
+
+    // the failed task goes to another daemon, the host with repeated faults gets no tasks anymore
+    uint32_t m_retries = 0;
+    uint32_t m_quarantineLimit = 0;
+    std::unordered_map<std::string, uint32_t> m_hostFaults;
+    std::unordered_set<std::string> m_quarantine;
+    bool m_isHostLost = false; // the retried tasks may have no host to go
+
+    // the streamed inputs and outputs, the key is the node and the task id
+    std::map<std::pair<TcpProtobufNode*, uint32_t>, Upload> m_uploads;
+    // the key of the output writer, the downloads are keyed by the output index too
+    std::map<std::tuple<TcpProtobufNode*, uint32_t, uint32_t>, uint64_t> m_downloads;
+    // the requested inputs of the manifests, the key is the node and the hash
+    std::map<std::pair<TcpProtobufNode*, std::string>, std::unique_ptr<ChunkReader>> m_blobUploads;
+
+    std::atomic<uint64_t> m_countUploadsSkipped = 0;
+    std::atomic<uint64_t> m_bytesUploadsSkipped = 0;
+    std::atomic<uint64_t> m_countOutputsUnchanged = 0;
 };
@@ -12,9 +12,11 @@
 #include "stringex.h"
 #include "net/udp_node.h"
 
+#include "host_performance.h"
 #include "project.h"
 #include "global_constants.h"
 
+#include "input_cache.h"
 #include "udp_daemonserver.h"
 
 // window.cpp
@@ -67,6 +69,12 @@ int main(int argc, const char** argv)
         return 1;
     }
 
+    HostPerformance performance;
+
+    performance.calibrate();
+    LOGN("Calibration: score %.2f, cores %u, memory %llu MB",
+         performance.getScore(), performance.getCores(), performance.getMemory() >> 20);
+
     if (!su::Net::initWinSock2())
     {
         LOGE("Can not initialize network driver");
@@ -83,8 +91,10 @@ int main(int argc, const char** argv)
         createWindow(consoleTitleName.c_str());
     });
 
+    InputCache inputCache(projects.getCacheDir(), projects.getCacheCount(), projects.getCacheSize(), &su::Log::instance());
     su::Net::UdpNode udpNode;
-    UdpDaemonServer udpServer(udpNode, Global::udpMulticastIp, Global::udpDefaultPort, projects, &su::Log::instance());
+    UdpDaemonServer udpServer(udpNode, Global::udpMulticastIp, Global::udpDefaultPort,
+                              projects, performance, inputCache, &su::Log::instance());
 
     udpServer.run(0);
     udpServer.start(true);
@@ -0,0 +1,245 @@
+
+#include "input_cache.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "log.h"
+
+#include "file_transfer.h"
+#include "sha256.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // the hard link is free, but it works only on the same volume
+    bool linkFile(const std::string& from, const std::string& to)
+    {
+        std::error_code ec;
+
+        fs::remove(to, ec);
+        fs::create_hard_link(from, to, ec);
+        if (!ec)
+        {
+            return true;
+        }
+
+        return fs::copy_file(from, to, fs::copy_options::overwrite_existing, ec) && !ec;
+    }
+
+    // the links share the attributes with the blob, so the tool can not write its input and change the blob
+    void protect(const std::string& filename)
+    {
+        std::error_code ec;
+
+        fs::permissions(filename, fs::perms::owner_write | fs::perms::group_write | fs::perms::others_write,
+                        fs::perm_options::remove, ec);
+    }
+
+    // the read-only link is deleted, the blob keeps its content and its attributes
+    bool removeFile(const std::string& filename)
+    {
+        std::error_code ec;
+
+        return fs::remove(filename, ec) || !ec;
+    }
+
+    std::string hashFile(const std::string& filename)
+    {
+        std::ifstream file(filename, std::ios::binary);
+        std::string buffer(FileTransfer::chunkSize, '\0');
+        Sha256 sha;
+
+        if (!file.is_open())
+        {
+            return "";
+        }
+
+        while (file)
+        {
+            file.read(buffer.data(), buffer.size());
+            sha.update(buffer.data(), static_cast<size_t>(file.gcount()));
+        }
+
+        return file.bad() ? "" : sha.final();
+    }
+}
+
+InputCache::InputCache(const std::string& dir, size_t maxCount, uint64_t maxSize, su::Log* plog) :
+    m_log(plog),
+    m_dir(dir),
+    m_maxCount(maxCount),
+    m_maxSize(maxSize)
+{
+    load();
+}
+
+bool InputCache::acquire(const std::string& filename, const std::string& hash)
+{
+    auto it = m_index.find(Sha256::toHex(hash));
+
+    if (it == m_index.end())
+    {
+        return false;
+    }
+
+    auto item = it->second;
+
+    // the blob is read-only, but its attributes may be changed by the other program
+    if (hashFile(blobName(item->m_hash)) != hash)
+    {
+        LOGSPW(m_log, "The blob '%s' is changed, it is removed from the input cache", item->m_hash.c_str());
+        drop(item);
+        return false;
+    }
+
+    if (!linkFile(blobName(item->m_hash), filename))
+    {
+        LOGSPW(m_log, "Can not link the blob '%s' to '%s'", item->m_hash.c_str(), filename.c_str());
+        return false;
+    }
+
+    std::error_code ec;
+
+    fs::last_write_time(blobName(item->m_hash), fs::file_time_type::clock::now(), ec);
+    m_items.splice(m_items.begin(), m_items, item);
+
+    return true;
+}
+
+void InputCache::put(const std::string& filename, const std::string& hash, uint64_t size)
+{
+    // the input of the old server has no hash and it is not cached
+    if (hash.size() != Sha256::digestSize)
+    {
+        return;
+    }
+
+    auto hex = Sha256::toHex(hash);
+    auto it = m_index.find(hex);
+
+    if (it != m_index.end())
+    {
+        m_items.splice(m_items.begin(), m_items, it->second);
+        return;
+    }
+
+    if (!linkFile(filename, blobName(hex)))
+    {
+        LOGSPW(m_log, "Can not add '%s' to the input cache", filename.c_str());
+        return;
+    }
+
+    protect(blobName(hex));
+
+    m_items.push_front({hex, size});
+    m_index[hex] = m_items.begin();
+    m_size += size;
+
+    evict();
+}
+
+std::unique_ptr<ChunkWriter> InputCache::create(const std::string& hash) const
+{
+    if (hash.size() != Sha256::digestSize)
+    {
+        return nullptr;
+    }
+
+    auto writer = std::make_unique<ChunkWriter>(blobName(Sha256::toHex(hash)));
+
+    return writer->isOpen() ? std::move(writer) : nullptr;
+}
+
+bool InputCache::add(const std::string& hash, ChunkWriter& writer)
+{
+    auto hex = Sha256::toHex(hash);
+
+    if (!writer.finish(hash) || !writer.commit())
+    {
+        LOGSPW(m_log, "Can not add the blob '%s' to the input cache", hex.c_str());
+        return false;
+    }
+
+    // the same content is received for the other request
+    if (auto it = m_index.find(hex); it != m_index.end())
+    {
+        m_items.splice(m_items.begin(), m_items, it->second);
+        return true;
+    }
+
+    protect(blobName(hex));
+
+    m_items.push_front({hex, writer.size()});
+    m_index[hex] = m_items.begin();
+    m_size += writer.size();
+
+    evict();
+
+    return true;
+}
+
+void InputCache::release(const std::string& filename)
+{
+    // the content stays in the store, the work directory keeps only the running inputs
+    if (!removeFile(filename))
+    {
+        LOGSPW(m_log, "Can not delete the input '%s'", filename.c_str());
+    }
+}
+
+void InputCache::load()
+{
+    std::error_code ec;
+    std::vector<std::pair<fs::file_time_type, Item>> blobs;
+
+    fs::create_directories(m_dir, ec);
+
+    for (const auto& entry : fs::directory_iterator(m_dir, ec))
+    {
+        auto name = entry.path().filename().string();
+
+        if (!entry.is_regular_file(ec) || name.size() != Sha256::digestSize * 2)
+        {
+            continue;
+        }
+
+        blobs.push_back({entry.last_write_time(ec), {name, entry.file_size(ec)}});
+    }
+
+    // the blob is touched, when it is used, so the recent ones go first
+    std::sort(blobs.begin(), blobs.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    for (const auto& [time, item] : blobs)
+    {
+        m_items.push_back(item);
+        m_index[item.m_hash] = std::prev(m_items.end());
+        m_size += item.m_size;
+    }
+
+    LOGSPN(m_log, "The input cache '%s' has %u blobs, %llu MB", m_dir.c_str(), m_items.size(), m_size >> 20);
+
+    evict();
+}
+
+void InputCache::evict()
+{
+    while (m_items.size() && (m_items.size() > m_maxCount || m_size > m_maxSize))
+    {
+        LOGSPI(m_log, "Evict '%s' from the input cache", m_items.back().m_hash.c_str());
+
+        drop(std::prev(m_items.end()));
+    }
+}
+
+void InputCache::drop(std::list<Item>::iterator item)
+{
+    // the inputs of the running tasks are the hard links or the copies, they are alive without the blob
+    removeFile(blobName(item->m_hash));
+    m_size -= item->m_size;
+    m_index.erase(item->m_hash);
+    m_items.erase(item);
+}
@@ -0,0 +1,58 @@
+
+#pragma once
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace su
+{
+class Log;
+}
+
+class ChunkWriter;
+
+// Content-addressed store of the task inputs. The blob is the file named by the sha256 of its content,
+// the input is linked from the store to the work directory, so the bytes are not written again.
+// The store lives longer than the connection to the server and the daemon process, so the repeated builds
+// find their inputs here. The hard link shares the content with the store, so the blob is read-only and the tool
+// can not write its input. The blob is checked by its hash, when it is used again
+class InputCache
+{
+    struct Item
+    {
+        std::string m_hash; // hex
+        uint64_t m_size = 0;
+    };
+
+public:
+    InputCache(const std::string& dir, size_t maxCount, uint64_t maxSize, su::Log* plog = nullptr);
+    virtual ~InputCache() = default;
+
+    // links the blob to the work directory, false if the store has no such content
+    bool acquire(const std::string& filename, const std::string& hash);
+    // adds the received input to the store
+    void put(const std::string& filename, const std::string& hash, uint64_t size);
+    // the received content of the manifest is written by the chunks to the temporary file of the store.
+    // It is added when it is finished, false if it does not match the hash
+    std::unique_ptr<ChunkWriter> create(const std::string& hash) const;
+    bool add(const std::string& hash, ChunkWriter& writer);
+    void release(const std::string& filename);
+
+private:
+    void load();
+    void evict();
+    void drop(std::list<Item>::iterator item);
+    std::string blobName(const std::string& hex) const { return m_dir + hex; }
+
+private:
+    su::Log* m_log = nullptr;
+    std::string m_dir = "";
+    size_t m_maxCount = 0;
+    uint64_t m_maxSize = 0;
+    uint64_t m_size = 0;
+
+    std::list<Item> m_items; // the last used is at the front
+    std::unordered_map<std::string, std::list<Item>::iterator> m_index;
+};
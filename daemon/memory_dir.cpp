@@ -0,0 +1,44 @@
+
+#include "memory_dir.h"
+
+#include <algorithm>
+#include <filesystem>
+
+#include "fileex.h"
+
+namespace fs = std::filesystem;
+
+MemoryDir::MemoryDir(const std::string& dir, uint64_t budget, uint64_t maxFile) :
+    m_dir(dir),
+    m_budget(budget),
+    m_maxFile(maxFile)
+{
+}
+
+bool MemoryDir::reserve(uint64_t inputSize)
+{
+    if (!isEnabled() || inputSize > m_maxFile || m_used + inputSize + m_maxFile > m_budget)
+    {
+        return false;
+    }
+
+    m_used += inputSize + m_maxFile;
+
+    return true;
+}
+
+void MemoryDir::release(uint64_t inputSize)
+{
+    m_used -= std::min(m_used, inputSize + m_maxFile);
+}
+
+std::string MemoryDir::getPath(const std::string& project) const
+{
+    std::string path = m_dir + project;
+    std::error_code ec;
+
+    su::fs::addSeparator(path);
+    fs::create_directories(path, ec);
+
+    return path;
+}
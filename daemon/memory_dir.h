@@ -0,0 +1,32 @@
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+// The RAM backed location of the task files, it is a RAM disk given by the configuration.
+// The task goes there if its inputs are not bigger than the threshold and the budget has a room
+// for the inputs and the output, the output is reserved as the threshold. The other tasks
+// use the work directory of the project. The tools see the memory dir as $(pdir).
+// The inputs in the memory are not added to the blob store, it is on the disk
+class MemoryDir
+{
+public:
+    MemoryDir(const std::string& dir, uint64_t budget, uint64_t maxFile);
+    virtual ~MemoryDir() = default;
+
+    bool isEnabled() const { return m_dir.size() && m_budget; }
+    uint64_t used() const { return m_used; }
+
+    // false, if the task goes to the disk
+    bool reserve(uint64_t inputSize);
+    void release(uint64_t inputSize);
+
+    std::string getPath(const std::string& project) const;
+
+private:
+    std::string m_dir = "";
+    uint64_t m_budget = 0;
+    uint64_t m_maxFile = 0;
+    uint64_t m_used = 0;
+};
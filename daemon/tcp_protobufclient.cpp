@@ -1,12 +1,18 @@
 
 #include "tcp_protobufclient.h"
 
+#include <algorithm>
 #include <filesystem>
 
 #include "fileex.h"
 #include "stringex.h"
 
+#include "host_performance.h"
+#include "input_cache.h"
 #include "project.h"
+#include "global_constants.h"
+#include "sha256.h"
+#include "wildcard.h"
 #pragma warning(disable:4251)
 #include "master.pb.h"
 #include "slave.pb.h"
@@ -14,9 +20,21 @@
 
 namespace fs = std::filesystem;
 
-TcpProtobufClient::TcpProtobufClient(TcpProtobufNode& node, Projects& projects, su::Log* plog) :
+namespace
+{
+    uint64_t elapsed(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+TcpProtobufClient::TcpProtobufClient(TcpProtobufNode& node, Projects& projects, HostPerformance& performance,
+                                     InputCache& inputCache, su::Log* plog) :
     su::Net::TcpClient(node, plog),
-    m_projects(projects)
+    m_projects(projects),
+    m_performance(performance),
+    m_inputCache(inputCache),
+    m_memoryDir(projects.getMemoryDir(), projects.getMemorySize(), projects.getMemoryMaxFile())
 {
 }
 
@@ -34,72 +52,372 @@ void TcpProtobufClient::doWork()
             continue;
         }
 
+        std::unique_ptr<Task> finished(task);
+        m_tasks.erase(m_tasks.begin() + ii);
+        --ii;
+
+        // the core is free now, so the prefetched task is started before the result is sent
+        startReadyTasks();
+
         Slave::Packet packet;
 
-        auto info = packet.mutable_info();
         auto result = packet.mutable_result();
         int exitCode = 0;
         auto resultCode = task->m_process->getProcessExitCode(&exitCode);
 
-        info->set_task_count(m_projects.getFreeCore() - (uint32_t)m_tasks.size());
+        fillInfo(*packet.mutable_info());
 
         result->set_id(task->m_id);
         result->set_exit_code(exitCode);
         result->set_process_code(static_cast<int32_t>(resultCode));
         result->set_outputfile(task->m_outputFile);
+        result->set_duration(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - task->m_startTime).count()));
+
+        LOGSPI(getLog(), "The task %u is finished!", task->m_id);
+
+        auto start = std::chrono::steady_clock::now();
 
-        if (su::fs::load(task->m_outputFile, *result->mutable_outputdata()) != su::fs::OK)
+        // the new server gets the output by the chunks, the result is sent after the last one
+        if (task->m_outputChunks)
         {
-            LOGSPI(getLog(), "Can not  transfer output file.", task->m_id);
-        }
+            auto reader = std::make_unique<ChunkReader>(task->m_outputFile);
 
-        LOGSPI(getLog(), "The task %u is finished!", task->m_id);
+            collectOutputs(*task);
 
-        if (!packet.IsInitialized())
+            task->m_fileTime += elapsed(start);
+
+            if (reader->isOpen())
+            {
+                result->set_outputchunks(true);
+                m_uploads.push_back({std::move(finished), std::move(reader), std::move(packet)});
+                continue;
+            }
+        }
+        else
         {
-            LOGSPE(getLog(), "The output protobuf message is not initialized!");
+            if (su::fs::load(task->m_outputFile, *result->mutable_outputdata()) != su::fs::OK)
+            {
+                LOGSPI(getLog(), "Can not  transfer output file.", task->m_id);
+            }
 
-            disconnect();
-            break;
+            task->m_fileTime += elapsed(start);
         }
 
-        if (!((TcpProtobufNode*)getNode())->send(packet))
+        if (!sendResult(std::move(finished), packet))
         {
-            LOGSPE(getLog(), "Can not send the protobuf message to the server.");
-            disconnect();
-            break;
+            return;
+        }
+    }
+
+    sendChunks();
+}
+
+bool TcpProtobufClient::sendChunks()
+{
+    auto node = static_cast<TcpProtobufNode*>(getNode());
+    Slave::Packet packet;
+    auto chunk = packet.add_chunks();
+    std::string raw;
+
+    // the packet and the buffers are reused, so one chunk is in the memory
+    for (size_t ii = 0; ii < m_uploads.size(); ++ii)
+    {
+        auto& upload = m_uploads[ii];
+        auto codec = upload.m_task->m_outputCodec;
+        uint64_t offset = 0;
+        bool isLast = false;
+
+        chunk->set_id(upload.m_task->m_id);
+        chunk->clear_last();
+        chunk->clear_digest();
+
+        if (upload.m_file)
+        {
+            chunk->set_file(upload.m_file);
+        }
+        else
+        {
+            chunk->clear_file();
         }
 
-        if (resultCode != su::Process::ExitCodeResult::Exited || exitCode)
+        for (auto start = std::chrono::steady_clock::now(); upload.m_reader->next(offset, raw, isLast); start = std::chrono::steady_clock::now())
         {
-            LOGSPE(getLog(), "Task %u: Fault to run process '%s %s' on '%s' directory. Status %i. Exit code %i",
-                   task->m_id,
-                   static_cast<int>(resultCode),
-                   exitCode);
+            upload.m_task->m_fileTime += elapsed(start);
+
+            // the incompressible data goes as is, the buffers are swapped
+            if (FileTransfer::pack(codec, raw, *chunk->mutable_data()) == FileTransfer::Raw)
+            {
+                chunk->mutable_data()->swap(raw);
+                chunk->clear_codec();
+                chunk->clear_rawsize();
+            }
+            else
+            {
+                chunk->set_codec(codec);
+                chunk->set_rawsize(static_cast<uint32_t>(raw.size()));
+            }
+
+            chunk->set_offset(offset);
+            if (upload.m_file && !offset)
+            {
+                chunk->set_name(upload.m_name);
+            }
+            else
+            {
+                chunk->clear_name();
+            }
+
+            if (isLast)
+            {
+                chunk->set_last(true);
+                chunk->set_digest(upload.m_reader->digest());
+            }
 
-            if (task->m_abortOnError)
+            if (!node->send(packet))
             {
-                LOGSPW(getLog(), "Disconnecting because the 'AbortOnError' flag is true");
+                LOGSPE(getLog(), "Can not send the output of task %u to the server.", upload.m_task->m_id);
                 disconnect();
-                break;
+                return false;
             }
         }
 
-        // Clear tmp files
-        su::fs::deleteFile(task->m_sourceFile);
-        su::fs::deleteFile(task->m_outputFile);
+        if (upload.m_reader->isSent() && nextOutput(upload))
+        {
+            --ii;
+            continue;
+        }
+
+        if (upload.m_reader->isOpen() && !upload.m_reader->isSent())
+        {
+            continue;
+        }
 
-        delete task;
-        m_tasks.erase(m_tasks.begin() + ii);
+        // the server fails the task, it has not got the last chunk
+        if (!upload.m_reader->isOpen())
+        {
+            LOGSPE(getLog(), "Can not read the output file '%s'", upload.m_task->m_outputFile.c_str());
+        }
+
+        auto task = std::move(upload.m_task);
+        auto result = std::move(upload.m_result);
+
+        m_uploads.erase(m_uploads.begin() + ii);
         --ii;
+
+        if (!sendResult(std::move(task), result))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void TcpProtobufClient::collectOutputs(Task& task)
+{
+    std::error_code ec;
+    std::vector<std::string> known = {su::String_tolower(task.m_outputFile), su::String_tolower(task.m_sourceFile)};
+
+    for (const auto& filename : task.m_inputFiles)
+    {
+        known.push_back(su::String_tolower(filename));
+    }
+
+    // the inputs and the output file are not collected twice
+    auto add = [&task, &known](const std::string& filename)
+    {
+        auto lower = su::String_tolower(filename);
+
+        if (std::find(known.begin(), known.end(), lower) == known.end())
+        {
+            known.push_back(lower);
+            task.m_outputFiles.push_back(filename);
+        }
+    };
+
+    // only the own dir of the task is searched, the files of the other tasks are not there
+    for (const auto& mask : task.m_outputMasks)
+    {
+        if (!mask.starts_with("$(pdir)") || mask.find("..") != std::string::npos)
+        {
+            LOGSPW(getLog(), "Task %u: the output '%s' is out of the task dir, it is not collected", task.m_id, mask.c_str());
+            continue;
+        }
+
+        fs::path path = su::String_replace(mask, "$(pdir)", task.m_workPath, true);
+        auto name = path.filename().string();
+
+        if (!Wildcard::isMask(name))
+        {
+            // the server fails the task without the declared output
+            if (fs::is_regular_file(path, ec))
+            {
+                add(path.string());
+            }
+            else
+            {
+                LOGSPW(getLog(), "Task %u: the declared output '%s' is not produced", task.m_id, path.string().c_str());
+            }
+            continue;
+        }
+
+        for (const auto& entry : fs::directory_iterator(path.parent_path(), ec))
+        {
+            if (entry.is_regular_file(ec) && Wildcard::isMatch(entry.path().filename().string(), name))
+            {
+                add(entry.path().string());
+            }
+        }
+    }
+
+    if (task.m_outputFiles.size())
+    {
+        LOGSPI(getLog(), "Task %u: collected %u other outputs", task.m_id, task.m_outputFiles.size());
+    }
+}
+
+bool TcpProtobufClient::nextOutput(Upload& upload)
+{
+    auto& task = *upload.m_task;
+
+    while (upload.m_next < task.m_outputFiles.size())
+    {
+        const auto& filename = task.m_outputFiles[upload.m_next++];
+        auto reader = std::make_unique<ChunkReader>(filename);
+
+        // the output file is in the work dir, the server gets the name related to it
+        if (!reader->isOpen() || !filename.starts_with(task.m_workPath))
+        {
+            LOGSPW(getLog(), "Can not read the output file '%s'", filename.c_str());
+            continue;
+        }
+
+        upload.m_reader = std::move(reader);
+        upload.m_name = "$(pdir)" + filename.substr(task.m_workPath.size());
+        ++upload.m_file;
+
+        upload.m_result.mutable_result()->add_outputfiles(upload.m_name);
+        return true;
+    }
+
+    return false;
+}
+
+bool TcpProtobufClient::sendResult(std::unique_ptr<Task> task, Slave::Packet& packet)
+{
+    if (!packet.IsInitialized())
+    {
+        LOGSPE(getLog(), "The output protobuf message is not initialized!");
+
+        disconnect();
+        return false;
+    }
+
+    if (!((TcpProtobufNode*)getNode())->send(packet))
+    {
+        LOGSPE(getLog(), "Can not send the protobuf message to the server.");
+        disconnect();
+        return false;
+    }
+
+    auto resultCode = static_cast<su::Process::ExitCodeResult>(packet.result().process_code());
+    int exitCode = packet.result().exit_code();
+
+    if (resultCode != su::Process::ExitCodeResult::Exited || exitCode)
+    {
+        LOGSPE(getLog(), "Task %u: Fault to run process '%s %s' on '%s' directory. Status %i. Exit code %i",
+               task->m_id,
+               task->m_application.c_str(),
+               task->m_commandLine.c_str(),
+               task->m_workingDir.c_str(),
+               static_cast<int>(resultCode),
+               exitCode);
+
+        if (task->m_abortOnError)
+        {
+            LOGSPW(getLog(), "Disconnecting because the 'AbortOnError' flag is true");
+            disconnect();
+            return false;
+        }
+    }
+
+    auto mode = task->m_isMemory ? 1 : 0;
+
+    removeFiles(*task);
+
+    ++m_countTasks[mode];
+    m_fileTime[mode] += task->m_fileTime;
+
+    LOGSPI(getLog(), "Task %u: the files took %llu us in the %s dir, %llu us per task on average",
+           task->m_id, task->m_fileTime, mode ? "memory" : "work",
+           m_fileTime[mode] / m_countTasks[mode]);
+
+    return true;
+}
+
+void TcpProtobufClient::removeFiles(Task& task)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // Clear tmp files, the input stays in the cache
+    m_inputCache.release(task.m_sourceFile);
+    su::fs::deleteFile(task.m_outputFile);
+
+    for (const auto& filename : task.m_inputFiles)
+    {
+        m_inputCache.release(filename);
+    }
+
+    for (const auto& filename : task.m_outputFiles)
+    {
+        su::fs::deleteFile(filename);
+    }
+
+    // the rest are the temporary files of the tool, the dir belongs to this task only
+    if (task.m_workPath.size())
+    {
+        std::error_code ec;
+
+        fs::remove_all(task.m_workPath, ec);
+    }
+
+    if (task.m_isMemory)
+    {
+        m_memoryDir.release(task.m_inputSize);
+        task.m_isMemory = false;
     }
+
+    task.m_fileTime += elapsed(start);
 }
 
 bool TcpProtobufClient::onConnect()
 {
     Slave::Packet packet;
 
-    packet.mutable_info()->set_task_count(m_projects.getFreeCore());
+    fillInfo(*packet.mutable_info());
+
+    // the transfers of the previous connection are not continued
+    for (auto& [id, download] : m_downloads)
+    {
+        removeFiles(*download.m_task);
+    }
+
+    for (auto& upload : m_uploads)
+    {
+        removeFiles(*upload.m_task);
+    }
+
+    for (auto& task : m_waiting)
+    {
+        removeFiles(*task);
+    }
+
+    m_downloads.clear();
+    m_uploads.clear();
+    m_waiting.clear();
+    m_requestedBlobs.clear();
+    m_blobDownloads.clear();
 
     TcpProtobufNode* node = static_cast<TcpProtobufNode*>(getNode());
 
@@ -126,6 +444,9 @@ bool TcpProtobufClient::onRecvFromNode()
             return false;
         }
 
+        // the coordinator keeps the connection while there are no tasks
+        TcpClient::restartKeepAliveTimer();
+
         if (packet.has_task())
         {
             if (!runTaskProcess(packet.task()))
@@ -135,6 +456,51 @@ bool TcpProtobufClient::onRecvFromNode()
             }
         }
 
+        for (auto& task : packet.tasks())
+        {
+            if (!runTaskProcess(task))
+            {
+                protoNode->clearRecvPackets();
+                return false;
+            }
+        }
+
+        if (packet.blobs_size())
+        {
+            receiveBlobs(packet);
+        }
+
+        // the chunks of the input go after its task
+        if (packet.chunks_size() && !receiveChunks(packet))
+        {
+            protoNode->clearRecvPackets();
+            return false;
+        }
+
+        for (auto& ack : packet.acks())
+        {
+            for (auto& upload : m_uploads)
+            {
+                if (upload.m_task->m_id == ack.id() && upload.m_file == ack.file())
+                {
+                    upload.m_reader->ack(ack.offset());
+                }
+            }
+        }
+
+        if (packet.has_cancel())
+        {
+            for (auto id : packet.cancel().id())
+            {
+                cancelTask(id);
+            }
+
+            Slave::Packet info;
+
+            fillInfo(*info.mutable_info());
+            protoNode->send(info);
+        }
+
         if (packet.has_system())
         {
             if (packet.system().has_close() && packet.system().close())
@@ -177,9 +543,27 @@ bool TcpProtobufClient::runTaskProcess(const Master::Task& packet)
     workingdir = su::String_replace(workingdir, "$(pdir)", prj->m_path, true);
     application = su::String_replace(application, "$(pdir)", prj->m_path, true);
 
-    commandline = su::String_replace(commandline, "$(pdir)", prj->m_workPath, true);
-    sourcefile = su::String_replace(sourcefile, "$(pdir)", prj->m_workPath, true);
-    outputfile = su::String_replace(outputfile, "$(pdir)", prj->m_workPath, true);
+    // the small task works in the memory dir, the big one and the task over the budget use the disk.
+    // The inputs of the manifest are copied there too, so they are counted with the input.
+    // Every task has its own dir, so the tasks do not share the linked inputs and the collected outputs
+    uint64_t inputSize = packet.inputsize();
+
+    for (const auto& input : packet.inputs())
+    {
+        inputSize += input.size();
+    }
+
+    bool isMemory = packet.has_inputsize() && m_memoryDir.reserve(inputSize);
+    std::string workPath = (isMemory ? m_memoryDir.getPath(prjname) : prj->m_workPath) + "task" + std::to_string(++m_countDirs);
+    std::error_code ec;
+
+    su::fs::addSeparator(workPath);
+    fs::remove_all(workPath, ec); // the dir of the previous daemon run
+    fs::create_directories(workPath, ec);
+
+    commandline = su::String_replace(commandline, "$(pdir)", workPath, true);
+    sourcefile = su::String_replace(sourcefile, "$(pdir)", workPath, true);
+    outputfile = su::String_replace(outputfile, "$(pdir)", workPath, true);
 
     LOGSPI(getLog(), "Run task %u: prj='%s' wdir='%s' app='%s' params='%s' src='%s' out='%s'",
            packet.id(),
@@ -190,27 +574,393 @@ bool TcpProtobufClient::runTaskProcess(const Master::Task& packet)
            sourcefile.c_str(),
            outputfile.c_str());
 
-    Task* task = new Task;
+    std::unique_ptr<Task> task = std::make_unique<Task>();
 
     task->m_id = packet.id();
+    task->m_application = application;
+    task->m_commandLine = commandline;
+    task->m_workingDir = workingdir;
     task->m_sourceFile = sourcefile;
     task->m_outputFile = outputfile;
     task->m_abortOnError = packet.abortonerror();
+    task->m_outputChunks = packet.outputchunks();
+    task->m_outputCodec = packet.outputcodec() < 32 ? FileTransfer::choose(1u << packet.outputcodec()) : FileTransfer::Raw;
+    task->m_inputHash = packet.inputhash();
+    task->m_isMemory = isMemory;
+    task->m_inputSize = inputSize;
+    task->m_workPath = workPath;
+    task->m_outputMasks.assign(packet.outputs().begin(), packet.outputs().end());
+
+    auto start = std::chrono::steady_clock::now();
+
+    linkInputs(*task, packet, workPath);
+
+    // the input is written to the disk by the chunks, the task is ready after the last one
+    if (packet.inputchunks())
+    {
+        auto writer = std::make_unique<ChunkWriter>(task->m_sourceFile);
+
+        if (!writer->isOpen())
+        {
+            LOGSPE(getLog(), "Cant save '%s' source file", sourcefile.c_str());
+            removeFiles(*task);
+            return false;
+        }
+
+        task->m_fileTime += elapsed(start);
+        m_downloads[packet.id()] = {std::move(task), std::move(writer)};
+        return true;
+    }
+    else if (packet.has_inputdata())
+    {
+        size_t result = su::fs::save(task->m_sourceFile, packet.inputdata());
+        if (result != su::fs::OK)
+        {
+            LOGSPE(getLog(), "Cant save '%s' source file. Error %u", sourcefile.c_str(), result);
+            removeFiles(*task);
+            return false;
+        }
+
+        // the blob store is on the disk, the input in the memory is not copied there
+        if (!task->m_isMemory)
+        {
+            m_inputCache.put(task->m_sourceFile, packet.inputhash(), packet.inputdata().size());
+        }
+    }
+    else if (!packet.has_inputhash() || !m_inputCache.acquire(task->m_sourceFile, packet.inputhash()))
+    {
+        LOGSPI(getLog(), "The input of task %u is not in the cache, request it from the server", packet.id());
+
+        Slave::Packet request;
+
+        request.mutable_request()->set_id(packet.id());
+        static_cast<TcpProtobufNode*>(getNode())->send(request);
+        removeFiles(*task);
+        return true;
+    }
+
+    task->m_fileTime += elapsed(start);
+    readyTask(std::move(task));
+
+    return true;
+}
+
+bool TcpProtobufClient::receiveChunks(const Master::Packet& packet)
+{
+    Slave::Packet acks;
+    std::string raw;
+
+    for (const auto& chunk : packet.chunks())
+    {
+        if (chunk.has_hash())
+        {
+            if (!receiveBlob(chunk, acks, raw))
+            {
+                return false;
+            }
+            continue;
+        }
+
+        auto it = m_downloads.find(chunk.id());
+
+        // the task was cancelled
+        if (it == m_downloads.end())
+        {
+            continue;
+        }
+
+        auto& writer = it->second.m_writer;
+        auto& fileTime = it->second.m_task->m_fileTime;
+
+        if (chunk.codec() && !FileTransfer::unpack(chunk.codec(), chunk.data(), chunk.rawsize(), raw))
+        {
+            LOGSPE(getLog(), "Can not decompress the input of task %u", chunk.id());
+            return false;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        if (!writer->write(chunk.offset(), chunk.codec() ? raw : chunk.data()))
+        {
+            LOGSPE(getLog(), "Cant save '%s' source file", it->second.m_task->m_sourceFile.c_str());
+            return false;
+        }
+
+        auto ack = acks.add_acks();
+
+        ack->set_id(chunk.id());
+        ack->set_offset(writer->size());
+
+        if (!chunk.last())
+        {
+            fileTime += elapsed(start);
+            continue;
+        }
+
+        if (!writer->finish(chunk.digest()) || !writer->commit())
+        {
+            LOGSPE(getLog(), "The input '%s' of task %u is corrupted", it->second.m_task->m_sourceFile.c_str(), chunk.id());
+            return false;
+        }
+
+        auto task = std::move(it->second.m_task);
+
+        if (!task->m_isMemory)
+        {
+            m_inputCache.put(task->m_sourceFile, writer->digest(), writer->size());
+        }
+        task->m_fileTime += elapsed(start);
+        m_downloads.erase(it);
+
+        readyTask(std::move(task));
+    }
+
+    if (acks.acks_size())
+    {
+        static_cast<TcpProtobufNode*>(getNode())->send(acks);
+    }
+
+    return true;
+}
+
+void TcpProtobufClient::linkInputs(Task& task, const Master::Task& packet, const std::string& workPath)
+{
+    Slave::Packet request;
+    std::error_code ec;
+
+    // the other inputs are linked from the blob store, the missing content is requested once for all tasks
+    for (const auto& input : packet.inputs())
+    {
+        auto filename = su::String_replace(input.file(), "$(pdir)", workPath, true);
+
+        task.m_inputFiles.push_back(filename);
+        fs::create_directories(fs::path(filename).parent_path(), ec);
+
+        if (m_inputCache.acquire(filename, input.hash()))
+        {
+            continue;
+        }
+
+        task.m_missing.push_back({filename, input.hash()});
+
+        if (m_requestedBlobs.insert(input.hash()).second)
+        {
+            request.add_blobs(input.hash());
+        }
+    }
+
+    if (request.blobs_size())
+    {
+        LOGSPI(getLog(), "Request %i inputs of the manifest of task %u from the server", request.blobs_size(), task.m_id);
+        static_cast<TcpProtobufNode*>(getNode())->send(request);
+    }
+}
+
+bool TcpProtobufClient::receiveBlob(const Transfer::Chunk& chunk, Slave::Packet& acks, std::string& raw)
+{
+    auto& writer = m_blobDownloads[chunk.hash()];
+
+    // the content is written to the store, the tasks are linked to it after the last chunk
+    if (!writer && !chunk.offset())
+    {
+        writer = m_inputCache.create(chunk.hash());
+    }
 
-    size_t result = su::fs::save(task->m_sourceFile, packet.inputdata());
-    if (result != su::fs::OK)
+    if (chunk.codec() && !FileTransfer::unpack(chunk.codec(), chunk.data(), chunk.rawsize(), raw))
     {
-        LOGSPE(getLog(), "Cant save '%s' source file. Error %u", sourcefile.c_str(), result);
+        LOGSPE(getLog(), "Can not decompress the input %s of the manifest", Sha256::toHex(chunk.hash()).c_str());
         return false;
     }
 
-    task->m_process = new su::Process::AppObject(application.c_str(),
-                                                 commandline.c_str(),
-                                                 workingdir.c_str(),
-                                                 su::Process::LaunchMode::NoConsole);
-    task->m_process->execute();
+    // the failed input is acknowledged too, the server finishes the transfer
+    auto ack = acks.add_acks();
+
+    ack->set_id(0);
+    ack->set_hash(chunk.hash());
+    ack->set_offset(chunk.offset() + (chunk.codec() ? chunk.rawsize() : chunk.data().size()));
+
+    if (writer && !writer->write(chunk.offset(), chunk.codec() ? raw : chunk.data()))
+    {
+        writer.reset();
+    }
+
+    if (!chunk.last())
+    {
+        return true;
+    }
+
+    bool isStored = writer && m_inputCache.add(chunk.hash(), *writer);
 
-    m_tasks.push_back(task);
+    m_blobDownloads.erase(chunk.hash());
+    readyBlob(chunk.hash(), isStored);
 
     return true;
 }
+
+void TcpProtobufClient::receiveBlobs(const Master::Packet& packet)
+{
+    // the server can not read these inputs
+    for (const auto& blob : packet.blobs())
+    {
+        m_blobDownloads.erase(blob.hash());
+        readyBlob(blob.hash(), false);
+    }
+}
+
+void TcpProtobufClient::readyBlob(const std::string& hash, bool isStored)
+{
+    // the task runs without the missing input, the tool reports the error
+    if (!isStored)
+    {
+        LOGSPE(getLog(), "The input %s of the manifest is not received", Sha256::toHex(hash).c_str());
+    }
+
+    m_requestedBlobs.erase(hash);
+
+    std::vector<std::unique_ptr<Task>> ready;
+
+    for (auto it = m_waiting.begin(); it != m_waiting.end(); )
+    {
+        auto& task = *it;
+
+        std::erase_if(task->m_missing, [this, &hash, isStored](const auto& missing)
+        {
+            if (missing.second != hash)
+            {
+                return false;
+            }
+
+            if (isStored && !m_inputCache.acquire(missing.first, missing.second))
+            {
+                LOGSPE(getLog(), "Can not link the input '%s'", missing.first.c_str());
+            }
+
+            return true;
+        });
+
+        if (task->m_missing.empty())
+        {
+            ready.push_back(std::move(task));
+            it = m_waiting.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    for (auto& task : ready)
+    {
+        readyTask(std::move(task));
+    }
+}
+
+void TcpProtobufClient::readyTask(std::unique_ptr<Task> task)
+{
+    auto id = task->m_id;
+
+    if (task->m_missing.size())
+    {
+        LOGSPI(getLog(), "Task %u waits for %u inputs of the manifest", id, task->m_missing.size());
+        m_waiting.push_back(std::move(task));
+        return;
+    }
+
+    m_ready.push_back(task.release());
+    startReadyTasks();
+
+    if (m_ready.size())
+    {
+        LOGSPI(getLog(), "Task %u is prefetched, %u tasks are waiting for the free core", id, m_ready.size());
+    }
+}
+
+void TcpProtobufClient::startReadyTasks()
+{
+    while (m_ready.size() && m_tasks.size() < m_projects.getFreeCore())
+    {
+        auto task = m_ready.front();
+        m_ready.pop_front();
+
+        task->m_process = new su::Process::AppObject(task->m_application.c_str(),
+                                                     task->m_commandLine.c_str(),
+                                                     task->m_workingDir.c_str(),
+                                                     su::Process::LaunchMode::NoConsole);
+        task->m_process->execute();
+        task->m_startTime = std::chrono::steady_clock::now();
+
+        m_tasks.push_back(task);
+    }
+}
+
+void TcpProtobufClient::cancelTask(uint32_t id)
+{
+    std::unique_ptr<Task> task;
+
+    auto running = std::find_if(m_tasks.begin(), m_tasks.end(), [id](const Task* item) { return item->m_id == id; });
+    if (running != m_tasks.end())
+    {
+        task.reset(*running);
+        m_tasks.erase(running);
+        task->m_process->terminate();
+    }
+
+    auto ready = std::find_if(m_ready.begin(), m_ready.end(), [id](const Task* item) { return item->m_id == id; });
+    if (ready != m_ready.end())
+    {
+        task.reset(*ready);
+        m_ready.erase(ready);
+    }
+
+    auto waiting = std::find_if(m_waiting.begin(), m_waiting.end(), [id](const auto& item) { return item->m_id == id; });
+    if (waiting != m_waiting.end())
+    {
+        task = std::move(*waiting);
+        m_waiting.erase(waiting);
+    }
+
+    if (auto download = m_downloads.find(id); download != m_downloads.end())
+    {
+        task = std::move(download->second.m_task);
+        m_downloads.erase(download);
+    }
+
+    auto upload = std::find_if(m_uploads.begin(), m_uploads.end(), [id](const Upload& item) { return item.m_task->m_id == id; });
+    if (upload != m_uploads.end())
+    {
+        task = std::move(upload->m_task);
+        m_uploads.erase(upload);
+    }
+
+    if (!task)
+    {
+        LOGSPW(getLog(), "Can not cancel the task %u, it is not found", id);
+        return;
+    }
+
+    LOGSPI(getLog(), "The task %u is cancelled by the server", id);
+
+    removeFiles(*task);
+
+    startReadyTasks();
+}
+
+void TcpProtobufClient::fillInfo(Slave::Info& info) const
+{
+    int32_t freeCores = static_cast<int32_t>(m_projects.getFreeCore()) - static_cast<int32_t>(m_tasks.size());
+    int32_t freePrefetch = static_cast<int32_t>(m_projects.getPrefetch()) -
+                           static_cast<int32_t>(m_ready.size() + m_downloads.size() + m_waiting.size());
+
+    info.set_task_count(std::max(freeCores, 0));
+    info.set_prefetch_count(std::max(freePrefetch, 0));
+    info.set_version(Global::protocolVersion);
+    info.set_score(m_performance.getScore());
+    info.set_cores(m_performance.getCores());
+    info.set_memory(m_performance.getMemory());
+    info.set_codecs(FileTransfer::codecs);
+
+    for (const auto& name : m_projects.getNames())
+    {
+        info.add_projects(name);
+    }
+}
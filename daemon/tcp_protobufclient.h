@@ -2,31 +2,78 @@
 #pragma once
 #define WIN32_LEAN_AND_MEAN
 
+#include <chrono>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+
 #include "win/process.h"
 #include "net/tcp_client.h"
 #include "tcp_protobufnode.h"
+#include "file_transfer.h"
+#include "memory_dir.h"
 
 #pragma warning(disable:4251)
 #include "master.pb.h"
+#include "slave.pb.h"
 #pragma warning(default:4251)
 
 class Projects;
+class HostPerformance;
+class InputCache;
 
 class TcpProtobufClient : public su::Net::TcpClient
 {
     struct Task
     {
-        su::Process::AppObject* m_process;
+        ~Task() { delete m_process; }
+
+        su::Process::AppObject* m_process = nullptr;
         //Master::Packet m_packet;
         uint32_t m_id = 0;
+        std::string m_application = "";
+        std::string m_commandLine = "";
+        std::string m_workingDir = "";
         std::string m_sourceFile = "";
         std::string m_outputFile = "";
         bool m_abortOnError = false;
+        bool m_outputChunks = false;
+        FileTransfer::Codec m_outputCodec = FileTransfer::Raw;
+        std::string m_inputHash = "";
+        std::chrono::steady_clock::time_point m_startTime;
+        bool m_isMemory = false;
+        uint64_t m_inputSize = 0;
+        uint64_t m_fileTime = 0; // microseconds of the work with the input and the output files
+        std::vector<std::string> m_inputFiles; // the other inputs of the manifest
+        std::vector<std::pair<std::string, std::string>> m_missing; // the file and the hash, they are requested
+        std::string m_workPath = ""; // the own dir of the task, it is $(pdir) for the tool
+        std::vector<std::string> m_outputMasks; // the other outputs, $(pdir) related
+        std::vector<std::string> m_outputFiles; // the collected other outputs
+    };
+
+    // the input is received by the chunks, the task waits for the last one
+    struct Download
+    {
+        std::unique_ptr<Task> m_task;
+        std::unique_ptr<ChunkWriter> m_writer;
+    };
+
+    // the output is sent by the chunks, the result goes after the last one.
+    // The other outputs are sent one by one after the output file
+    struct Upload
+    {
+        std::unique_ptr<Task> m_task;
+        std::unique_ptr<ChunkReader> m_reader;
+        Slave::Packet m_result;
+        uint32_t m_file = 0;   // the index of the sent output, 0 is the output file
+        std::string m_name = "";
+        size_t m_next = 0;     // the next of the collected outputs
     };
 
 public:
     TcpProtobufClient() = delete;
-    TcpProtobufClient(TcpProtobufNode& client, Projects& projects, su::Log* plog = nullptr);
+    TcpProtobufClient(TcpProtobufNode& client, Projects& projects, HostPerformance& performance,
+                      InputCache& inputCache, su::Log* plog = nullptr);
     virtual ~TcpProtobufClient() = default;
 
 protected:
@@ -38,10 +85,39 @@ protected:
 
 private:
     bool runTaskProcess(const Master::Task& packet);
+    bool receiveChunks(const Master::Packet& packet);
+    bool receiveBlob(const Transfer::Chunk& chunk, Slave::Packet& acks, std::string& raw);
+    void receiveBlobs(const Master::Packet& packet);
+    void readyBlob(const std::string& hash, bool isStored);
+    void linkInputs(Task& task, const Master::Task& packet, const std::string& workPath);
+    bool sendChunks();
+    void collectOutputs(Task& task);
+    bool nextOutput(Upload& upload);
+    bool sendResult(std::unique_ptr<Task> task, Slave::Packet& packet);
+    void readyTask(std::unique_ptr<Task> task);
+    void startReadyTasks();
+    void cancelTask(uint32_t id);
+    void fillInfo(Slave::Info& info) const;
+    void removeFiles(Task& task);
 
 private:
     std::mutex m_mutex;
     Projects& m_projects;
+    HostPerformance& m_performance;
+    InputCache& m_inputCache;
     std::vector<Task*> m_tasks;
+    std::deque<Task*> m_ready; // received tasks waiting for the free core
+    std::unordered_map<uint32_t, Download> m_downloads;
+    std::vector<Upload> m_uploads;
+    std::vector<std::unique_ptr<Task>> m_waiting; // the tasks waiting for the missing inputs of the manifest
+    std::unordered_set<std::string> m_requestedBlobs;
+    std::unordered_map<std::string, std::unique_ptr<ChunkWriter>> m_blobDownloads; // the hash and its temporary file
+    uint64_t m_countDirs = 0;
+
+    // the overhead of the task files in the disk and the memory modes
+    MemoryDir m_memoryDir;
+    uint64_t m_countTasks[2] = {0, 0};
+    uint64_t m_fileTime[2] = {0, 0};
+
 };
 
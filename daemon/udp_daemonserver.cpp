@@ -1,6 +1,7 @@
 
 #include "udp_daemonserver.h"
 
+#include "host_performance.h"
 #include "project.h"
 #include "global_constants.h"
 #include "whoishere.h"
@@ -8,9 +9,12 @@
 #include "tcp_protobufclient.h"
 
 UdpDaemonServer::UdpDaemonServer(su::Net::UdpNode& node, const std::string& ip, uint16_t port,
-                                 Projects& projects, su::Log* plog) :
+                                 Projects& projects, HostPerformance& performance, InputCache& inputCache,
+                                 su::Log* plog) :
     su::Net::UdpServer(node, ip, port, plog),
     m_projects(projects),
+    m_performance(performance),
+    m_inputCache(inputCache),
     m_clientNode(Global::tcpMagicNumber, -1, plog)
 {
 }
@@ -23,6 +27,12 @@ void UdpDaemonServer::doWork()
 
     if (m_status == Idle)
     {
+        // the calibration does not run together with the tasks
+        if (m_performance.isExpired(std::chrono::minutes(10)))
+        {
+            m_performance.calibrate();
+            LOGSPI(getLog(), "Calibration: score %.2f", m_performance.getScore());
+        }
         return;
     }
 
@@ -114,7 +124,7 @@ bool UdpDaemonServer::onRecvFromNode()
             continue;
         }
 
-        m_client = std::make_unique<TcpProtobufClient>(m_clientNode, m_projects, getLog());
+        m_client = std::make_unique<TcpProtobufClient>(m_clientNode, m_projects, m_performance, m_inputCache, getLog());
         m_client->run(0);
         m_client->connect(hostIp, hostPort);
         m_status = Status::Connectig;
@@ -8,13 +8,16 @@
 
 class TcpProtobufClient;
 class Projects;
+class HostPerformance;
+class InputCache;
 
 class UdpDaemonServer : public su::Net::UdpServer
 {
 public:
     UdpDaemonServer() = delete;
     UdpDaemonServer(su::Net::UdpNode& node, const std::string& ip, uint16_t port,
-                    Projects& projects, su::Log* plog = nullptr);
+                    Projects& projects, HostPerformance& performance, InputCache& inputCache,
+                    su::Log* plog = nullptr);
     virtual ~UdpDaemonServer();
 
 protected:
@@ -35,6 +38,8 @@ private:
     std::mutex m_mutex;
     su::Crc32 m_crc32;
     Projects& m_projects;
+    HostPerformance& m_performance;
+    InputCache& m_inputCache;
     Status m_status = Idle;
     TcpProtobufNode m_clientNode;
     std::unique_ptr<TcpProtobufClient> m_client;
@@ -9,21 +9,48 @@ TcpProtobufNode::TcpProtobufNode(uint32_t magic, int32_t id, su::Log* plog) :
 TcpProtobufNode::TcpProtobufNode(uint32_t magic, SOCKET socket, const sockaddr_in& addr, int32_t id, su::Log* plog) :
     su::Net::PacketNode(magic, socket, addr, id, plog)
 {
+    m_host = su::Net::ipToString(addr.sin_addr.s_addr);
 }
 
 size_t TcpProtobufNode::send(const ::google::protobuf::MessageLite& message)
 {
+    // the server, the coordinator and the main thread may send at once, so the buffer is per thread
+    thread_local std::string buffer;
+
+    if (!serialize(message, buffer))
+    {
+        return false;
+    }
+
+    size_t result = su::Net::PacketNode::send(buffer.data(), buffer.size());
+
+    if (buffer.capacity() > maxKeptBuffer)
+    {
+        std::string().swap(buffer);
+    }
+
+    return result;
+}
+
+bool TcpProtobufNode::serialize(const ::google::protobuf::MessageLite& message, std::string& buffer)
+{
+    if (!message.IsInitialized())
+    {
+        return false;
+    }
+
     size_t size = message.ByteSizeLong();
 
-    if (!size || !message.IsInitialized())
+    if (!size)
     {
         return false;
     }
 
-    std::string data;
-    message.SerializeToString(&data);
+    // the sizes are cached by ByteSizeLong, the message is serialized once without the reallocations
+    buffer.resize(size);
+    message.SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t*>(buffer.data()));
 
-    return su::Net::PacketNode::send(data.data(), data.size());
+    return true;
 }
 
 bool TcpProtobufNode::onRecivedMessage(::google::protobuf::MessageLite& message)
@@ -1,6 +1,10 @@
 
 #pragma once
 
+#include <string>
+#include <unordered_set>
+
+#include "net/net.h"
 #include "net/packetnode.h"
 
 #pragma warning(disable:4251)
@@ -10,6 +14,9 @@
 class TcpProtobufNode : public su::Net::PacketNode
 {
 public:
+    // the buffer of the usual message is kept, the buffer of the huge one is freed after the send
+    static const size_t maxKeptBuffer = 8 << 20;
+
     TcpProtobufNode(uint32_t magic, int32_t id = -1, su::Log* plog = nullptr);
     TcpProtobufNode(uint32_t magic, SOCKET socket, const sockaddr_in& addr, int32_t id = -1, su::Log* plog = nullptr);
     virtual ~TcpProtobufNode() = default;
@@ -18,6 +25,23 @@ public:
     virtual size_t send(const ::google::protobuf::MessageLite& message);
     virtual bool onRecivedMessage(::google::protobuf::MessageLite& message);
 
+    // false, if the message is empty or not initialized. The buffer is reused, it is not freed
+    static bool serialize(const ::google::protobuf::MessageLite& message, std::string& buffer);
+
+    bool isSupported(const std::string& project) const { return m_projects.empty() || m_projects.contains(project); }
+
 public:
     int32_t m_freeCores = 0;
+    uint32_t m_protocol = 1;
+    std::string m_host = "";
+    float m_score = 1.0f;
+    uint32_t m_cores = 0;
+    uint64_t m_memory = 0;
+    std::unordered_set<std::string> m_projects; // empty for the old daemon, it gets tasks of any project
+
+    // the compression of the chunks, the old daemon has no codecs
+    uint32_t m_codecs = 0;
+    uint64_t m_bytesRaw = 0;
+    uint64_t m_bytesWire = 0;
+    uint64_t m_codecTime = 0; // us
 };
@@ -0,0 +1,133 @@
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "check.h"
+#include "file_transfer.h"
+#include "fileex.h"
+#include "memory_dir.h"
+
+namespace fs = std::filesystem;
+
+// The file overhead of the small task in the memory dir and in the work dir. Every task does what the daemon does:
+// makes its dir, writes the input by the chunks, the tool writes the output, the output is read by the chunks
+// and the dir is removed. The memory dir is the RAM disk given by the first argument, the work dir is the temp
+// dir or the second argument. Without the RAM disk only the work dir is measured
+namespace
+{
+
+const size_t countTasks = 200;
+const uint64_t memorySize = 512 << 20;
+const uint64_t maxFile = 16 << 20;
+const double maxLoss = 1.5;        // the larger inputs are dominated by the hashing, they are the same in both dirs
+
+// the time of one task, us
+double runTask(const std::string& dir, size_t index, const std::string& input)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::string workPath = dir + "task" + std::to_string(index) + "/";
+    std::error_code ec;
+
+    fs::create_directories(workPath, ec);
+
+    ChunkWriter writer(workPath + "input.cpp");
+    CHECK(writer.isOpen());
+
+    for (size_t offset = 0; offset < input.size(); offset += FileTransfer::chunkSize)
+    {
+        CHECK(writer.write(offset, input.substr(offset, FileTransfer::chunkSize)));
+    }
+
+    CHECK(writer.finish() && writer.commit());
+
+    // the tool writes the output of the same size
+    {
+        std::ofstream output(workPath + "output.obj", std::ios::binary);
+        output.write(input.data(), input.size());
+    }
+
+    ChunkReader reader(workPath + "output.obj");
+    uint64_t offset = 0;
+    std::string data;
+    bool isLast = false;
+
+    CHECK(reader.isOpen());
+
+    while (!reader.isSent())
+    {
+        CHECK(reader.next(offset, data, isLast));
+        reader.ack(offset + data.size());
+    }
+
+    fs::remove_all(workPath, ec);
+
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+// the average time of the task, us
+double measure(const std::string& dir, const std::string& input)
+{
+    double sum = 0;
+
+    for (size_t ii = 0; ii < countTasks; ++ii)
+    {
+        sum += runTask(dir, ii, input);
+    }
+
+    return sum / countTasks;
+}
+
+}
+
+// bench_memory_dir [ram disk dir] [work dir]
+int main(int argc, char* argv[])
+{
+    std::string diskDir = (argc > 2 ? fs::path(argv[2]) : fs::temp_directory_path() / "fdb_bench_disk").string();
+    std::string ramDir = argc > 1 ? argv[1] : "";
+
+    su::fs::addSeparator(diskDir);
+    if (ramDir.size())
+    {
+        su::fs::addSeparator(ramDir);
+    }
+
+    MemoryDir memory(ramDir, memorySize, maxFile);
+    std::string memoryDir = memory.isEnabled() ? memory.getPath("bench") : "";
+
+    std::printf("%10s %14s %14s\n", "input", "work dir, us", "memory dir, us");
+
+    for (size_t size : {size_t(1) << 10, size_t(16) << 10, size_t(256) << 10, size_t(4) << 20})
+    {
+        std::string input(size, 'x');
+
+        CHECK(!memory.isEnabled() || memory.reserve(size));
+
+        double disk = measure(diskDir, input);
+        double ram = memory.isEnabled() ? measure(memoryDir, input) : 0;
+
+        memory.release(size);
+
+        if (memory.isEnabled())
+        {
+            std::printf("%10zu %14.1f %14.1f\n", size, disk, ram);
+            CHECK(ram < disk * maxLoss);
+        }
+        else
+        {
+            std::printf("%10zu %14.1f %14s\n", size, disk, "-");
+        }
+    }
+
+    std::error_code ec;
+
+    fs::remove_all(diskDir, ec);
+    if (memory.isEnabled())
+    {
+        fs::remove_all(memoryDir, ec);
+    }
+
+    return 0;
+}
@@ -0,0 +1,182 @@
+
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "console.h"
+#include "global_constants.h"
+#include "master.pb.h"
+#include "task_queue.h"
+#include "tcp_protobufnode.h"
+
+// The ramp-up of the new daemons from the connection to the full utilisation. Before the batch dispatch
+// the server sent one task per daemon in every pass of its thread, the pass runs on the tick of the thread or
+// on the capacity report. Now the pass fills every free core of the daemon by one packet. The tasks go through
+// the task queue and are serialized as the server does it, the network is not used. The passes, the packets
+// and the time of the server thread are counted until every core is busy, the tasks do not finish meanwhile
+namespace
+{
+
+const size_t countTasks = 20000;
+
+struct Result
+{
+    size_t m_passes = 0;
+    size_t m_packets = 0;
+    size_t m_bytes = 0;
+    double m_us = 0;
+};
+
+std::vector<std::unique_ptr<TcpProtobufNode>> makeNodes(size_t count, uint32_t cores)
+{
+    std::vector<std::unique_ptr<TcpProtobufNode>> nodes;
+
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        auto node = std::make_unique<TcpProtobufNode>(Global::tcpMagicNumber, static_cast<int32_t>(ii));
+
+        node->m_host = "host" + std::to_string(ii);
+        node->m_protocol = Global::protocolVersion;
+        node->m_cores = cores;
+        node->m_freeCores = cores;
+
+        nodes.push_back(std::move(node));
+    }
+
+    return nodes;
+}
+
+void makeTasks(std::deque<TaskInfo>& tasks)
+{
+    for (size_t ii = 0; ii < countTasks; ++ii)
+    {
+        auto& task = tasks.emplace_back(static_cast<uint32_t>(ii + 1));
+        auto& message = task.m_message;
+
+        message.set_project("prj0");
+        message.set_outputfile("$(pdir)output.obj");
+        message.set_application("cl.exe");
+        message.set_commandline("/c /nologo /O2 /EHsc /Fo$(pdir)output.obj $(pdir)input.cpp");
+        message.set_workingdir("$(pdir)");
+        message.set_sourcefile("$(pdir)input.cpp");
+        message.set_inputsize(32 << 10);
+
+        task.m_priority = countTasks - ii;
+    }
+}
+
+void send(const Master::Packet& packet, Result& result)
+{
+    thread_local std::string buffer;
+
+    CHECK(TcpProtobufNode::serialize(packet, buffer));
+
+    ++result.m_packets;
+    result.m_bytes += buffer.size();
+}
+
+// one pass of the server over the daemon
+void dispatch(TaskQueue& queue, TcpProtobufNode* node, bool isBatch, Result& result)
+{
+    Master::Packet batch;
+
+    while (node->m_freeCores > 0)
+    {
+        auto task = queue.pop(node);
+        if (!task)
+        {
+            break;
+        }
+
+        Master::Packet packet;
+
+        packet.mutable_task()->CopyFrom(task->m_message);
+
+        CHECK(queue.assign(node, task));
+        --node->m_freeCores;
+
+        if (!isBatch)
+        {
+            send(packet, result);
+            return;
+        }
+
+        batch.add_tasks()->Swap(packet.mutable_task());
+    }
+
+    if (batch.tasks_size())
+    {
+        send(batch, result);
+    }
+}
+
+Result rampUp(size_t countNodes, uint32_t cores, bool isBatch)
+{
+    auto nodes = makeNodes(countNodes, cores);
+    std::deque<TaskInfo> tasks;
+    TaskQueue queue;
+    Result result;
+
+    makeTasks(tasks);
+
+    for (auto& task : tasks)
+    {
+        CHECK(queue.push(&task));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    while (queue.countInFlight() < countNodes * cores)
+    {
+        for (const auto& node : nodes)
+        {
+            dispatch(queue, node.get(), isBatch, result);
+        }
+
+        ++result.m_passes;
+    }
+
+    result.m_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    return result;
+}
+
+}
+
+int main()
+{
+    struct Cluster
+    {
+        size_t m_nodes;
+        uint32_t m_cores;
+    };
+
+    const std::vector<Cluster> clusters = {{4, 8}, {16, 16}, {32, 64}};
+
+    std::printf("%-10s | %-36s | %-36s\n", "", "one task per pass", "batch");
+    std::printf("%-10s | %6s %8s %10s %8s | %6s %8s %10s %8s\n", "cluster",
+                "passes", "packets", "bytes", "us", "passes", "packets", "bytes", "us");
+
+    for (const auto& cluster : clusters)
+    {
+        auto single = rampUp(cluster.m_nodes, cluster.m_cores, false);
+        auto batch = rampUp(cluster.m_nodes, cluster.m_cores, true);
+        auto name = std::to_string(cluster.m_nodes) + " x " + std::to_string(cluster.m_cores);
+
+        std::printf("%-10s | %6zu %8zu %10zu %8.0f | %6zu %8zu %10zu %8.0f\n", name.c_str(),
+                    single.m_passes, single.m_packets, single.m_bytes, single.m_us,
+                    batch.m_passes, batch.m_packets, batch.m_bytes, batch.m_us);
+
+        // every core waited for its own pass before, now the daemon is full after the first one
+        CHECK(single.m_passes == cluster.m_cores);
+        CHECK(batch.m_passes == 1);
+        CHECK(batch.m_packets == cluster.m_nodes);
+        CHECK(batch.m_bytes <= single.m_bytes);
+    }
+
+    return 0;
+}
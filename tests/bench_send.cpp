@@ -0,0 +1,193 @@
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "master.pb.h"
+#include "slave.pb.h"
+#include "tcp_protobufnode.h"
+
+// The allocations and the time per outgoing message before and after the reused buffer. Before, every message
+// was serialized into the new string by SerializeToString, it computed the sizes again. After, the sizes cached
+// by ByteSizeLong are used and the buffer of the thread is reused, as TcpProtobufNode::send does. Both paths copy
+// the message into the buffer once, the framing copy of the packet node is the same and it is not measured
+namespace
+{
+
+const size_t countMessages = 2000;
+const size_t minBytes = 256 << 20;   // the large messages are sent fewer times
+
+std::atomic<size_t> countAllocs = 0;
+std::atomic<size_t> bytesAllocs = 0;
+
+struct Result
+{
+    double m_allocs;
+    double m_bytes;
+    double m_ns;
+};
+
+Master::Packet makeTask(size_t inputSize)
+{
+    Master::Packet packet;
+    auto task = packet.mutable_task();
+
+    task->set_id(1234);
+    task->set_project("prj0");
+    task->set_outputfile("$(pdir)output.obj");
+    task->set_application("cl.exe");
+    task->set_commandline("/c /nologo /O2 /EHsc /Fo$(pdir)output.obj $(pdir)input.cpp");
+    task->set_workingdir("$(pdir)");
+    task->set_sourcefile("$(pdir)input.cpp");
+    task->set_inputsize(inputSize);
+    if (inputSize)
+    {
+        task->set_inputdata(std::string(inputSize, 'x'));
+    }
+
+    return packet;
+}
+
+Master::Packet makeChunks(size_t count, size_t size)
+{
+    Master::Packet packet;
+
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        auto chunk = packet.add_chunks();
+
+        chunk->set_id(static_cast<uint32_t>(ii + 1));
+        chunk->set_offset(0);
+        chunk->set_data(std::string(size, 'x'));
+    }
+
+    return packet;
+}
+
+Slave::Packet makeInfo()
+{
+    Slave::Packet packet;
+    auto info = packet.mutable_info();
+
+    info->set_task_count(8);
+    info->set_score(1.5f);
+    info->set_cores(16);
+    info->set_memory(64ull << 30);
+
+    return packet;
+}
+
+template <class Send>
+Result measure(const ::google::protobuf::MessageLite& message, Send&& send)
+{
+    size_t count = std::max<size_t>(countMessages / 10, std::min(countMessages, minBytes / message.ByteSizeLong()));
+
+    // the first message allocates the reused buffer
+    send(message);
+
+    countAllocs = 0;
+    bytesAllocs = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        send(message);
+    }
+
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    return {static_cast<double>(countAllocs) / count, static_cast<double>(bytesAllocs) / count, elapsed / count};
+}
+
+}
+
+void* operator new(size_t size)
+{
+    ++countAllocs;
+    bytesAllocs += size;
+
+    if (void* ptr = std::malloc(size ? size : 1))
+    {
+        return ptr;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+int main()
+{
+    struct Message
+    {
+        const char* m_name;
+        const ::google::protobuf::MessageLite& m_message;
+    };
+
+    auto info = makeInfo();
+    auto task = makeTask(0);
+    auto chunks = makeChunks(4, 64 << 10);
+    auto chunk = makeChunks(1, 1 << 20);
+    auto legacy = makeTask(16 << 20);
+
+    const std::vector<Message> messages =
+    {
+        {"info", info},
+        {"task", task},
+        {"4 x 64 KB chunks", chunks},
+        {"1 MB chunk", chunk},
+        {"16 MB input", legacy},
+    };
+
+    std::printf("%-29s | %-32s | %-32s\n", "", "before, per message", "after, per message");
+    std::printf("%-18s %10s | %8s %12s %10s | %8s %12s %10s\n", "message", "size",
+                "allocs", "bytes", "ns", "allocs", "bytes", "ns");
+
+    for (const auto& message : messages)
+    {
+        auto before = measure(message.m_message, [](const ::google::protobuf::MessageLite& message)
+        {
+            std::string data;
+
+            CHECK(message.SerializeToString(&data));
+        });
+
+        auto after = measure(message.m_message, [](const ::google::protobuf::MessageLite& message)
+        {
+            thread_local std::string buffer;
+
+            CHECK(TcpProtobufNode::serialize(message, buffer));
+
+            if (buffer.capacity() > TcpProtobufNode::maxKeptBuffer)
+            {
+                std::string().swap(buffer);
+            }
+        });
+
+        std::printf("%-18s %10zu | %8.2f %12.0f %10.0f | %8.2f %12.0f %10.0f\n", message.m_name,
+                    message.m_message.ByteSizeLong(), before.m_allocs, before.m_bytes, before.m_ns,
+                    after.m_allocs, after.m_bytes, after.m_ns);
+
+        // the kept buffer is not allocated again, the huge one is allocated once as before
+        bool isKept = message.m_message.ByteSizeLong() <= TcpProtobufNode::maxKeptBuffer;
+
+        CHECK(after.m_allocs <= (isKept ? 0.0 : 1.0));
+        CHECK(after.m_allocs <= before.m_allocs);
+    }
+
+    return 0;
+}
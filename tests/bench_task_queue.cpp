@@ -0,0 +1,179 @@
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "console.h"
+#include "global_constants.h"
+#include "task_queue.h"
+#include "tcp_protobufnode.h"
+
+// Dispatch cost of the task queue by the count of the tasks. Every task is pushed, popped by a node,
+// assigned and returned by its result, a few of them are retried. The cost per task must stay near flat,
+// so the largest queue is compared with the smallest one. The ordered sets grow as log n and miss the cache
+// on the large queues, the scan of the queue per dispatch would grow as n. The queue is measured with one build
+// and with several builds of the coordinator. One node supports only the rare project, its tasks run out first
+namespace
+{
+
+const size_t countNodes = 16;
+const size_t batchSize = 8;       // the tasks taken by a node per capacity report
+const size_t minWork = 200000;    // the small queues are measured several times
+const double maxGrowth = 30.0;    // the scan per dispatch is about 1000 times slower on 1000 times more tasks
+const size_t rareProject = 1000;  // every such task is of the rare project
+
+std::vector<std::unique_ptr<TcpProtobufNode>> makeNodes()
+{
+    std::vector<std::unique_ptr<TcpProtobufNode>> nodes;
+
+    for (size_t ii = 0; ii < countNodes; ++ii)
+    {
+        auto node = std::make_unique<TcpProtobufNode>(Global::tcpMagicNumber, static_cast<int32_t>(ii));
+
+        node->m_host = "host" + std::to_string(ii);
+        node->m_protocol = Global::protocolVersion;
+
+        // the old daemon does not report its projects, the new one goes by the project index
+        if (ii == 0)
+        {
+            node->m_projects = {"rare"};
+        }
+        else if (ii % 2)
+        {
+            node->m_projects = {"prj0", "prj1", "rare"};
+        }
+
+        nodes.push_back(std::move(node));
+    }
+
+    return nodes;
+}
+
+void makeTasks(size_t count, size_t builds, const std::vector<std::unique_ptr<TcpProtobufNode>>& nodes, std::deque<TaskInfo>& tasks)
+{
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        auto& task = tasks.emplace_back(static_cast<uint32_t>(ii + 1));
+
+        task.m_priority = (ii * 2654435761u) % 100000;
+        task.m_build = static_cast<uint32_t>(ii % builds);
+        task.m_message.set_project(ii % rareProject ? "prj" + std::to_string(ii % 2) : "rare");
+
+        // a third of the tasks ran on a known host in the previous build
+        if (ii % 3 == 0)
+        {
+            task.m_affinity = nodes[ii % nodes.size()]->m_host;
+        }
+    }
+}
+
+// returns the time of the whole dispatch
+std::chrono::nanoseconds dispatch(std::deque<TaskInfo>& tasks, const std::vector<std::unique_ptr<TcpProtobufNode>>& nodes)
+{
+    TaskQueue queue;
+    std::vector<TaskInfo*> inFlight;
+    size_t countDone = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (auto& task : tasks)
+    {
+        CHECK(queue.push(&task));
+    }
+
+    while (countDone < tasks.size())
+    {
+        for (const auto& node : nodes)
+        {
+            for (size_t ii = 0; ii < batchSize; ++ii)
+            {
+                auto task = queue.pop(node.get());
+                if (!task)
+                {
+                    break;
+                }
+
+                CHECK(queue.assign(node.get(), task));
+                inFlight.push_back(task);
+            }
+
+            for (auto task : inFlight)
+            {
+                CHECK(queue.unassign(node.get(), task->m_message.id()) == task);
+
+                // every hundredth task fails once and goes back to the queue
+                if (task->m_message.id() % 100 == 0 && !task->m_attempts)
+                {
+                    ++task->m_attempts;
+                    CHECK(queue.push(task));
+                    continue;
+                }
+
+                CHECK(task->moveTo(TaskState::Done));
+                ++countDone;
+            }
+
+            inFlight.clear();
+        }
+    }
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    CHECK(!queue.countPending());
+    CHECK(!queue.countInFlight());
+
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed);
+}
+
+// the best time of the repeated runs per task, ns
+double measure(size_t count, size_t builds, const std::vector<std::unique_ptr<TcpProtobufNode>>& nodes)
+{
+    double best = 0;
+
+    for (size_t run = 0; run * count < minWork; ++run)
+    {
+        std::deque<TaskInfo> tasks;
+
+        makeTasks(count, builds, nodes, tasks);
+
+        double perTask = static_cast<double>(dispatch(tasks, nodes).count()) / count;
+        best = run ? std::min(best, perTask) : perTask;
+    }
+
+    return best;
+}
+
+}
+
+// the largest count may be given, 1000000 by default
+int main(int argc, char* argv[])
+{
+    size_t maxCount = argc > 1 ? static_cast<size_t>(std::atoll(argv[1])) : 1000000;
+    auto nodes = makeNodes();
+    const size_t builds[] = {1, 4};
+    double first[2] = {};
+    double last[2] = {};
+
+    std::printf("%10s %14s %14s\n", "tasks", "1 build, ns", "4 builds, ns");
+
+    for (size_t count = 1000; count <= maxCount; count *= 10)
+    {
+        for (size_t ii = 0; ii < 2; ++ii)
+        {
+            last[ii] = measure(count, builds[ii], nodes);
+            first[ii] = first[ii] ? first[ii] : last[ii];
+        }
+
+        std::printf("%10zu %14.1f %14.1f\n", count, last[0], last[1]);
+    }
+
+    CHECK(last[0] < first[0] * maxGrowth);
+    CHECK(last[1] < first[1] * maxGrowth);
+
+    return 0;
+}
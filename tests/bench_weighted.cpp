@@ -0,0 +1,220 @@
+
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "console.h"
+#include "global_constants.h"
+#include "task_queue.h"
+#include "tcp_protobufnode.h"
+
+// Makespan of the weighted dispatch against the first-come one on the synthetic clusters of the mixed nodes.
+// The tasks go through the task queue of the server, the time is simulated: the task runs its reference time
+// divided by the score of the node. The first-come dispatch fills the nodes in the order of the connection and
+// gives every node the longest task. The weighted one fills the fastest nodes first and gives the shortest tasks
+// to the nodes below half of the best score, as the server does with --weighted=1
+namespace
+{
+
+const float slowNodeRatio = 0.5f;   // the same as in the server
+const double maxLoss = 0.05;        // the slow node may take a long task at the end, the speculation is not simulated
+
+struct NodeKind
+{
+    size_t m_count;
+    float m_score;
+    uint32_t m_cores;
+};
+
+struct Cluster
+{
+    const char* m_name;
+    std::vector<NodeKind> m_kinds;
+};
+
+struct Finish
+{
+    double m_time;
+    TcpProtobufNode* m_node;
+    TaskInfo* m_task;
+
+    bool operator>(const Finish& other) const { return m_time > other.m_time; }
+};
+
+std::vector<std::unique_ptr<TcpProtobufNode>> makeNodes(const Cluster& cluster)
+{
+    std::vector<std::unique_ptr<TcpProtobufNode>> nodes;
+
+    for (const auto& kind : cluster.m_kinds)
+    {
+        for (size_t ii = 0; ii < kind.m_count; ++ii)
+        {
+            auto node = std::make_unique<TcpProtobufNode>(Global::tcpMagicNumber, static_cast<int32_t>(nodes.size()));
+
+            node->m_host = "host" + std::to_string(nodes.size());
+            node->m_protocol = Global::protocolVersion;
+            node->m_score = kind.m_score;
+            node->m_cores = kind.m_cores;
+
+            nodes.push_back(std::move(node));
+        }
+    }
+
+    // the nodes connect in no particular order
+    for (size_t ii = 0; ii < nodes.size(); ++ii)
+    {
+        std::swap(nodes[ii], nodes[(ii * 7 + 3) % nodes.size()]);
+    }
+
+    return nodes;
+}
+
+// the most of the tasks are short, a few of them are ten times longer, ms on the reference machine
+void makeTasks(size_t count, std::deque<TaskInfo>& tasks)
+{
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        auto& task = tasks.emplace_back(static_cast<uint32_t>(ii + 1));
+        uint32_t random = (ii * 2654435761u) >> 8;
+
+        task.m_expected = ii % 20 ? 500 + random % 1500 : 10000 + random % 20000;
+        task.m_priority = task.m_expected;
+    }
+}
+
+// returns the time of the last result, ms
+double simulate(const Cluster& cluster, size_t countTasks, bool isWeighted)
+{
+    auto nodes = makeNodes(cluster);
+    std::deque<TaskInfo> tasks;
+    TaskQueue queue;
+    std::priority_queue<Finish, std::vector<Finish>, std::greater<Finish>> running;
+    float maxScore = 0;
+    double now = 0;
+
+    makeTasks(countTasks, tasks);
+
+    for (auto& task : tasks)
+    {
+        CHECK(queue.push(&task));
+    }
+
+    for (const auto& node : nodes)
+    {
+        maxScore = std::max(maxScore, node->m_score);
+    }
+
+    if (isWeighted)
+    {
+        std::stable_sort(nodes.begin(), nodes.end(), [](const auto& a, const auto& b)
+        {
+            return a->m_score > b->m_score;
+        });
+    }
+
+    for (;;)
+    {
+        for (const auto& node : nodes)
+        {
+            bool isShortest = isWeighted && node->m_score < maxScore * slowNodeRatio;
+
+            while (queue.countInFlight(node.get()) < node->m_cores)
+            {
+                auto task = queue.pop(node.get(), isShortest);
+                if (!task)
+                {
+                    break;
+                }
+
+                CHECK(queue.assign(node.get(), task));
+                running.push({now + task->m_expected / node->m_score, node.get(), task});
+            }
+        }
+
+        if (running.empty())
+        {
+            break;
+        }
+
+        auto finish = running.top();
+        running.pop();
+
+        now = finish.m_time;
+        CHECK(queue.unassign(finish.m_node, finish.m_task->m_message.id()) == finish.m_task);
+        CHECK(finish.m_task->moveTo(TaskState::Done));
+    }
+
+    CHECK(!queue.countPending());
+
+    return now;
+}
+
+// the time of the ideal split of the whole work over the whole capacity, ms
+double lowerBound(const Cluster& cluster, size_t countTasks)
+{
+    std::deque<TaskInfo> tasks;
+    double work = 0;
+    double capacity = 0;
+
+    makeTasks(countTasks, tasks);
+
+    for (const auto& task : tasks)
+    {
+        work += task.m_expected;
+    }
+
+    for (const auto& kind : cluster.m_kinds)
+    {
+        capacity += kind.m_count * kind.m_cores * kind.m_score;
+    }
+
+    return work / capacity;
+}
+
+}
+
+int main()
+{
+    const std::vector<Cluster> clusters =
+    {
+        {"uniform", {{8, 1.0f, 8}}},
+        {"two fast, six slow", {{2, 2.0f, 8}, {6, 0.5f, 8}}},
+        {"old laptops", {{4, 1.5f, 16}, {4, 1.0f, 8}, {8, 0.3f, 4}}},
+        {"one fast", {{1, 3.0f, 16}, {12, 0.6f, 4}}},
+    };
+
+    double sumFirst = 0;
+    double sumWeighted = 0;
+
+    std::printf("%-20s %6s %12s %12s %12s %8s\n", "cluster", "tasks", "bound, s", "first, s", "weighted, s", "gain");
+
+    for (const auto& cluster : clusters)
+    {
+        for (size_t countTasks : {200, 2000})
+        {
+            double bound = lowerBound(cluster, countTasks);
+            double first = simulate(cluster, countTasks, false);
+            double weighted = simulate(cluster, countTasks, true);
+
+            std::printf("%-20s %6zu %12.1f %12.1f %12.1f %7.1f%%\n", cluster.m_name, countTasks, bound / 1000,
+                        first / 1000, weighted / 1000, (first - weighted) * 100 / first);
+
+            CHECK(weighted <= first * (1 + maxLoss));
+            CHECK(weighted >= bound);
+
+            sumFirst += first;
+            sumWeighted += weighted;
+        }
+    }
+
+    std::printf("%-20s %6s %12s %12.1f %12.1f %7.1f%%\n", "total", "", "", sumFirst / 1000, sumWeighted / 1000,
+                (sumFirst - sumWeighted) * 100 / sumFirst);
+
+    CHECK(sumWeighted < sumFirst);
+
+    return 0;
+}
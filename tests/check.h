@@ -0,0 +1,16 @@
+
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+// the failed check prints its place and fails the whole test
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            std::exit(1); \
+        } \
+    } while (false)
@@ -0,0 +1,69 @@
+
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "completion_queue.h"
+
+namespace
+{
+
+const uint32_t countItems = 1000000;
+
+// the producer and the consumer run at the same time, the items cross many blocks
+void testStress()
+{
+    CompletionQueue queue;
+
+    std::thread producer([&queue]()
+    {
+        for (uint32_t id = 1; id <= countItems; ++id)
+        {
+            CompletionQueue::Item item;
+
+            item.m_id = id;
+            item.m_build = id % 7;
+            item.m_doneIp = id % 100 ? "" : std::to_string(id);
+            queue.push(std::move(item));
+        }
+    });
+
+    std::vector<CompletionQueue::Item> items;
+    uint32_t next = 1;
+    auto progress = std::chrono::steady_clock::now();
+
+    while (next <= countItems)
+    {
+        // the signal of the already read item wakes up the consumer without items, it is not the stall
+        if (!queue.wait(items, std::chrono::milliseconds(100)))
+        {
+            CHECK(std::chrono::steady_clock::now() - progress < std::chrono::seconds(10));
+            continue;
+        }
+
+        progress = std::chrono::steady_clock::now();
+
+        for (const auto& item : items)
+        {
+            CHECK(item.m_id == next);
+            CHECK(item.m_build == next % 7);
+            CHECK(item.m_doneIp == (next % 100 ? "" : std::to_string(next)));
+            ++next;
+        }
+    }
+
+    producer.join();
+
+    // every item is taken once
+    CHECK(!queue.wait(items, std::chrono::milliseconds(10)));
+    CHECK(items.empty());
+}
+
+}
+
+int main()
+{
+    testStress();
+
+    return 0;
+}
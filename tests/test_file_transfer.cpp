@@ -0,0 +1,133 @@
+
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "check.h"
+#include "file_transfer.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+std::string makeData(size_t size)
+{
+    std::string data(size, '\0');
+    uint32_t seed = 12345;
+
+    for (auto& c : data)
+    {
+        seed = seed * 1103515245 + 12345;
+        c = static_cast<char>(seed >> 24);
+    }
+
+    return data;
+}
+
+void save(const fs::path& filename, const std::string& data)
+{
+    std::ofstream file(filename, std::ios::binary);
+    file.write(data.data(), data.size());
+}
+
+std::string load(const fs::path& filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+struct Chunk
+{
+    uint64_t m_offset = 0;
+    std::string m_data = "";
+    bool m_isLast = false;
+};
+
+// the file larger than the window is sent only while the receiver acknowledges the written chunks
+void testWindow(const fs::path& dir)
+{
+    const auto data = makeData(2 * FileTransfer::windowSize + FileTransfer::chunkSize / 3);
+    const auto input = dir / "input.bin";
+    const auto output = dir / "output.bin";
+
+    save(input, data);
+
+    ChunkReader reader(input.string());
+    ChunkWriter writer(output.string());
+
+    CHECK(reader.isOpen());
+    CHECK(writer.isOpen());
+    CHECK(reader.size() == data.size());
+
+    uint64_t acked = 0;
+    size_t rounds = 0;
+
+    while (!reader.isSent())
+    {
+        std::vector<Chunk> sent;
+        Chunk chunk;
+
+        while (reader.next(chunk.m_offset, chunk.m_data, chunk.m_isLast))
+        {
+            sent.push_back(chunk);
+        }
+
+        // the window is full or the file is sent, the reader does not go on without the ack
+        CHECK(sent.size());
+        CHECK(sent.back().m_offset + sent.back().m_data.size() - acked <= FileTransfer::windowSize);
+        CHECK(!reader.next(chunk.m_offset, chunk.m_data, chunk.m_isLast));
+
+        for (const auto& sentChunk : sent)
+        {
+            CHECK(writer.write(sentChunk.m_offset, sentChunk.m_data));
+        }
+
+        acked = writer.size();
+        reader.ack(acked);
+        ++rounds;
+    }
+
+    CHECK(rounds > 2);
+    CHECK(writer.size() == data.size());
+    CHECK(writer.finish(reader.digest()));
+    CHECK(writer.commit());
+    CHECK(load(output) == data);
+}
+
+// the corrupted file does not replace the old one
+void testDigest(const fs::path& dir)
+{
+    const auto output = dir / "corrupted.bin";
+
+    save(output, "old");
+
+    {
+        ChunkWriter writer(output.string());
+
+        CHECK(writer.write(0, "new"));
+        CHECK(!writer.finish(Sha256::get("other")));
+        CHECK(!writer.commit());
+    }
+
+    CHECK(load(output) == "old");
+    CHECK(!fs::exists(output.string() + ".part"));
+}
+
+}
+
+int main()
+{
+    const auto dir = fs::temp_directory_path() / "fdb_test_file_transfer";
+
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    testWindow(dir);
+    testDigest(dir);
+
+    fs::remove_all(dir);
+
+    return 0;
+}
@@ -0,0 +1,144 @@
+
+#include <string>
+
+#include "check.h"
+#include "file_transfer.h"
+#include "lz.h"
+
+namespace
+{
+
+std::string makeRandom(size_t size)
+{
+    std::string data(size, '\0');
+    uint64_t seed = 0x9E3779B97F4A7C15ull;
+
+    for (auto& c : data)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        c = static_cast<char>(seed);
+    }
+
+    return data;
+}
+
+std::string makeText(size_t size)
+{
+    const std::string line = "#include \"file_transfer.h\" // the chunk of the source file\n";
+    std::string data;
+
+    for (size_t ii = 0; data.size() < size; ++ii)
+    {
+        data += line + std::to_string(ii) + "\n";
+    }
+
+    data.resize(size);
+
+    return data;
+}
+
+// the data goes through the codec as the chunk does, the incompressible one is sent raw
+void checkRoundTrip(const std::string& data)
+{
+    std::string packed;
+    std::string unpacked;
+
+    if (FileTransfer::pack(FileTransfer::Lz, data, packed) == FileTransfer::Raw)
+    {
+        CHECK(packed.empty());
+        return;
+    }
+
+    CHECK(packed.size() < data.size());
+    CHECK(FileTransfer::unpack(FileTransfer::Lz, packed, data.size(), unpacked));
+    CHECK(unpacked == data);
+}
+
+void testEmpty()
+{
+    std::string out;
+
+    CHECK(!Lz::compress("", 0, out));
+    checkRoundTrip("");
+}
+
+void testIncompressible()
+{
+    auto data = makeRandom(64 * 1024);
+    std::string out;
+    std::string packed;
+
+    CHECK(!Lz::isCompressible(data.data(), data.size()));
+    CHECK(FileTransfer::pack(FileTransfer::Lz, data, packed) == FileTransfer::Raw);
+    CHECK(packed.empty());
+
+    // the block is not made smaller
+    CHECK(!Lz::compress(data.data(), data.size(), out));
+}
+
+void testRepetitive()
+{
+    std::string same(100000, 'a');
+    std::string out;
+    std::string unpacked;
+
+    CHECK(Lz::compress(same.data(), same.size(), out));
+    CHECK(out.size() < same.size() / 10);
+    CHECK(Lz::decompress(out.data(), out.size(), same.size(), unpacked));
+    CHECK(unpacked == same);
+
+    checkRoundTrip(makeText(200000));
+
+    // the short tails of the block are the literals
+    for (size_t size = 1; size < 64; ++size)
+    {
+        checkRoundTrip(std::string(size, 'b'));
+        checkRoundTrip(makeText(size));
+    }
+}
+
+void testLarge()
+{
+    auto data = makeText(FileTransfer::chunkSize * 3 + 12345);
+    std::string out;
+    std::string unpacked;
+
+    CHECK(Lz::compress(data.data(), data.size(), out));
+    CHECK(Lz::decompress(out.data(), out.size(), data.size(), unpacked));
+    CHECK(unpacked == data);
+
+    // the mixed data, the matches are far from each other
+    auto mixed = makeRandom(FileTransfer::chunkSize + 777);
+    mixed += mixed.substr(0, FileTransfer::chunkSize / 2);
+    mixed += makeText(FileTransfer::chunkSize);
+
+    checkRoundTrip(mixed);
+}
+
+void testCorrupted()
+{
+    auto data = makeText(10000);
+    std::string out;
+    std::string unpacked;
+
+    CHECK(Lz::compress(data.data(), data.size(), out));
+
+    // the wrong size and the cut block are refused
+    CHECK(!Lz::decompress(out.data(), out.size(), data.size() + 1, unpacked));
+    CHECK(!Lz::decompress(out.data(), out.size() / 2, data.size(), unpacked));
+}
+
+}
+
+int main()
+{
+    testEmpty();
+    testIncompressible();
+    testRepetitive();
+    testLarge();
+    testCorrupted();
+
+    return 0;
+}
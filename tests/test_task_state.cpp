@@ -0,0 +1,157 @@
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "console.h"
+
+// The state machine of the task under the racing daemons. Two copies of every task report their results at once,
+// the lost node puts the task back to the queue and it is dispatched again. Every task must end in one final state,
+// only one result wins it, and the final state is not changed after it is seen
+namespace
+{
+
+const uint32_t countTasks = 200000;
+
+bool isFinal(TaskState state)
+{
+    return state == TaskState::Done || state == TaskState::Failed;
+}
+
+void testAllowed()
+{
+    const TaskState states[] = {TaskState::Pending, TaskState::Dispatched, TaskState::Running, TaskState::Done, TaskState::Failed};
+
+    for (auto from : states)
+    {
+        for (auto to : states)
+        {
+            bool isExpected = false;
+
+            switch (from)
+            {
+                case TaskState::Pending: isExpected = to == TaskState::Dispatched || isFinal(to); break;
+                case TaskState::Dispatched: isExpected = to != TaskState::Dispatched; break;
+                case TaskState::Running: isExpected = to == TaskState::Pending || isFinal(to); break;
+                default: break;
+            }
+
+            CHECK(TaskInfo::isAllowed(from, to) == isExpected);
+        }
+    }
+}
+
+void testRace()
+{
+    std::deque<TaskInfo> tasks;
+    std::vector<std::atomic<uint32_t>> winners(countTasks);
+    std::atomic<uint64_t> countMoves = 0;
+    std::atomic<bool> isDone = false;
+
+    for (uint32_t id = 0; id < countTasks; ++id)
+    {
+        tasks.emplace_back(id);
+        CHECK(tasks.back().moveTo(TaskState::Dispatched));
+    }
+
+    // the result of one copy, the copies go in the opposite orders so they meet in the middle
+    auto copy = [&](bool isForward, TaskState to)
+    {
+        for (uint32_t ii = 0; ii < countTasks; ++ii)
+        {
+            auto id = isForward ? ii : countTasks - 1 - ii;
+
+            if (tasks[id].moveTo(id % 3 ? to : TaskState::Failed))
+            {
+                ++winners[id];
+            }
+            ++countMoves;
+        }
+    };
+
+    // the node is lost, the task goes back to the queue and it is dispatched again
+    auto requeue = [&]()
+    {
+        for (uint32_t id = 0; id < countTasks; ++id)
+        {
+            if (tasks[id].moveTo(TaskState::Pending))
+            {
+                tasks[id].moveTo(TaskState::Dispatched);
+                ++countMoves;
+            }
+            ++countMoves;
+        }
+    };
+
+    // the main thread reads the states, the seen final state must stay
+    auto observe = [&]()
+    {
+        std::vector<TaskState> seen(countTasks, TaskState::Pending);
+
+        while (!isDone)
+        {
+            for (uint32_t id = 0; id < countTasks; ++id)
+            {
+                auto state = tasks[id].m_state.load();
+
+                CHECK(!isFinal(seen[id]) || state == seen[id]);
+                seen[id] = state;
+            }
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::thread observer(observe);
+    std::thread lost(requeue);
+    std::thread first(copy, true, TaskState::Done);
+    std::thread second(copy, false, TaskState::Done);
+
+    first.join();
+    second.join();
+    lost.join();
+
+    // the task requeued after both results is finished by the retried copy
+    for (uint32_t id = 0; id < countTasks; ++id)
+    {
+        if (!tasks[id].isFinished() && tasks[id].moveTo(TaskState::Done))
+        {
+            ++winners[id];
+        }
+    }
+
+    isDone = true;
+    observer.join();
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+    for (uint32_t id = 0; id < countTasks; ++id)
+    {
+        CHECK(winners[id] == 1);
+        CHECK(tasks[id].isFinished());
+        CHECK(!tasks[id].moveTo(TaskState::Pending));
+        CHECK(!tasks[id].moveTo(TaskState::Done));
+        CHECK(!tasks[id].moveTo(TaskState::Failed));
+    }
+
+    std::printf("%llu transitions in %lld us, %.1f M per second\n", static_cast<unsigned long long>(countMoves.load()),
+                static_cast<long long>(elapsed.count()), elapsed.count() ? double(countMoves) / elapsed.count() : 0.0);
+}
+
+}
+
+int main()
+{
+    testAllowed();
+
+    for (int round = 0; round < 3; ++round)
+    {
+        testRace();
+    }
+
+    return 0;
+}
@@ -0,0 +1,32 @@
+
+#include "check.h"
+#include "wildcard.h"
+
+int main()
+{
+    CHECK(Wildcard::isMask("*.obj"));
+    CHECK(Wildcard::isMask("a?.pdb"));
+    CHECK(!Wildcard::isMask("$(pdir)out\\a.pdb"));
+
+    CHECK(Wildcard::isMatch("a.obj", "*.obj"));
+    CHECK(Wildcard::isMatch("A.OBJ", "*.obj"));
+    CHECK(Wildcard::isMatch("a.obj", "a.obj"));
+    CHECK(Wildcard::isMatch("ab.pdb", "a?.pdb"));
+    CHECK(Wildcard::isMatch("a.b.c", "*.*"));
+    CHECK(Wildcard::isMatch("abcabd", "*abd"));
+    CHECK(Wildcard::isMatch("", "*"));
+    CHECK(!Wildcard::isMatch("", "?"));
+    CHECK(!Wildcard::isMatch("a.obj", "*.pdb"));
+    CHECK(!Wildcard::isMatch("a.objx", "*.obj"));
+    CHECK(!Wildcard::isMatch("a.pdb", "b?.pdb"));
+
+    // the output names of the daemon, the wildcards stay in one dir
+    CHECK(Wildcard::isMatch("$(pdir)out\\a.pdb", "$(pdir)out\\*.pdb"));
+    CHECK(Wildcard::isMatch("$(pdir)out\\a.pdb", "$(pdir)out\\a.pdb"));
+    CHECK(!Wildcard::isMatch("$(pdir)out\\sub\\a.pdb", "$(pdir)out\\*.pdb"));
+    CHECK(!Wildcard::isMatch("$(pdir)out\\a.pdb", "$(pdir)*.pdb"));
+    CHECK(!Wildcard::isMatch("$(pdir)out\\a.pdb", "$(pdir)out?a.pdb"));
+    CHECK(!Wildcard::isMatch("$(pdir)other.pdb", "$(pdir)out\\*.pdb"));
+
+    return 0;
+}